@@ -0,0 +1,27 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "Bench.h"
+
+#include <ebbrt/Debug.h>
+
+void bench::Report(const char* name, size_t ops,
+                   std::chrono::nanoseconds elapsed) {
+  // in tenths of a nanosecond, to keep floating point out of kprintf
+  auto tenths = ops == 0 ? 0 : elapsed.count() * 10 / ops;
+  ebbrt::kprintf("%-44s %10llu ops %8llu.%llu ns/op\n", name,
+                 static_cast<unsigned long long>(ops),
+                 static_cast<unsigned long long>(tenths / 10),
+                 static_cast<unsigned long long>(tenths % 10));
+}
+
+void bench::ReportAllocations(const char* name, size_t ops,
+                              uint64_t allocations) {
+  // in hundredths, an allocation made once per batch of events still shows
+  auto hundredths = ops == 0 ? 0 : allocations * 100 / ops;
+  ebbrt::kprintf("%-44s %10llu ops %8llu.%02llu allocs/op\n", name,
+                 static_cast<unsigned long long>(ops),
+                 static_cast<unsigned long long>(hundredths / 100),
+                 static_cast<unsigned long long>(hundredths % 100));
+}
@@ -0,0 +1,61 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef APPS_MICROBENCH_SRC_BENCH_H_
+#define APPS_MICROBENCH_SRC_BENCH_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <ebbrt/Clock.h>
+#include <ebbrt/Future.h>
+
+namespace bench {
+// Print the mean time per operation of a benchmark
+void Report(const char* name, size_t ops, std::chrono::nanoseconds elapsed);
+// Print the mean number of heap allocations per operation
+void ReportAllocations(const char* name, size_t ops, uint64_t allocations);
+
+// Time ops back to back invocations of f
+template <typename F> void Measure(const char* name, size_t ops, F&& f) {
+  ebbrt::clock::HighResTimer timer;
+  timer.tick();
+  for (size_t i = 0; i < ops; ++i) {
+    f();
+  }
+  Report(name, ops, timer.tock());
+}
+
+// Force the compiler to produce val without generating any code for it
+template <typename T> void DoNotOptimize(const T& val) {
+  asm volatile("" : : "r,m"(val) : "memory");
+}
+
+// Futures waited on by each of the ways of waiting compared by WaitBench and
+// CoAwaitBench
+const constexpr size_t kWaits = 100000;
+
+// A future fulfilled by an event spawned asynchronously on this core
+ebbrt::Future<int> AsyncValue(int val);
+
+// Each benchmark returns a future fulfilled once it has reported, so they can
+// be run one after the other without blocking
+ebbrt::Future<void> MovableFunctionBench();
+ebbrt::Future<void> FutureChainBench();
+ebbrt::Future<void> WaitBench();
+#ifdef __ebbrt__
+ebbrt::Future<void> SpawnBench();
+ebbrt::Future<void> RcuBench();
+#else
+// Only built with compilers that support coroutines, see CMakeLists.txt
+ebbrt::Future<void> CoAwaitBench();
+// Heap allocations made by the process so far, counted by interposing on
+// malloc
+uint64_t Allocations();
+ebbrt::Future<void> SpawnAllocBench();
+#endif
+}  // namespace bench
+
+#endif  // APPS_MICROBENCH_SRC_BENCH_H_
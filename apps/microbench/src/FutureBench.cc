@@ -0,0 +1,41 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "Bench.h"
+
+namespace {
+const constexpr size_t kOps = 1000000;
+const constexpr size_t kChainLength = 16;
+}  // namespace
+
+ebbrt::Future<void> bench::FutureChainBench() {
+  Measure("Promise SetValue+Get", kOps, []() {
+    ebbrt::Promise<int> p;
+    auto f = p.GetFuture();
+    p.SetValue(1);
+    DoNotOptimize(f.Get());
+  });
+
+  Measure("Then on a ready future", kOps, []() {
+    auto f = ebbrt::MakeReadyFuture<int>(1).Then(
+        [](ebbrt::Future<int> f) { return f.Get() + 1; });
+    DoNotOptimize(f.Get());
+  });
+
+  // continuations attached before the value arrives, one op per link
+  ebbrt::clock::HighResTimer timer;
+  timer.tick();
+  for (size_t i = 0; i < kOps / kChainLength; ++i) {
+    ebbrt::Promise<int> p;
+    auto f = p.GetFuture();
+    for (size_t j = 0; j < kChainLength; ++j) {
+      f = f.Then([](ebbrt::Future<int> f) { return f.Get() + 1; });
+    }
+    p.SetValue(0);
+    DoNotOptimize(f.Get());
+  }
+  Report("Then chain of 16, fulfilled afterwards", kOps, timer.tock());
+
+  return ebbrt::MakeReadyFuture<void>();
+}
@@ -0,0 +1,66 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "Bench.h"
+
+#include <array>
+#include <functional>
+
+#include <ebbrt/MoveLambda.h>
+
+namespace {
+const constexpr size_t kOps = 10000000;
+
+// Small enough to be stored inside a MovableFunction
+struct SmallCallable {
+  void operator()() { ++*counter; }
+  uint64_t* counter;
+  uint64_t pad[2];
+};
+
+// Too large to be stored inline, lives on the heap
+struct LargeCallable {
+  void operator()() { ++*counter; }
+  uint64_t* counter;
+  std::array<uint64_t, 16> pad;
+};
+
+template <typename Function, typename Callable>
+void MeasureCall(const char* name, uint64_t& counter) {
+  bench::Measure(name, kOps, [&counter]() {
+    Function f(Callable{&counter, {}});
+    f();
+    bench::DoNotOptimize(f);
+  });
+}
+
+template <typename Callable> void MeasureMove(const char* name) {
+  uint64_t counter = 0;
+  ebbrt::MovableFunction<void()> a(Callable{&counter, {}});
+  ebbrt::MovableFunction<void()> b;
+  // two moves per op, to leave the function where it started
+  bench::Measure(name, kOps, [&a, &b]() {
+    b = std::move(a);
+    bench::DoNotOptimize(b);
+    a = std::move(b);
+    bench::DoNotOptimize(a);
+  });
+}
+}  // namespace
+
+ebbrt::Future<void> bench::MovableFunctionBench() {
+  uint64_t counter = 0;
+  MeasureCall<ebbrt::MovableFunction<void()>, SmallCallable>(
+      "MovableFunction construct+call (inline)", counter);
+  MeasureCall<ebbrt::MovableFunction<void()>, LargeCallable>(
+      "MovableFunction construct+call (heap)", counter);
+  MeasureCall<std::function<void()>, SmallCallable>(
+      "std::function construct+call (small)", counter);
+  MeasureCall<std::function<void()>, LargeCallable>(
+      "std::function construct+call (large)", counter);
+  DoNotOptimize(counter);
+  MeasureMove<SmallCallable>("MovableFunction move x2 (inline)");
+  MeasureMove<LargeCallable>("MovableFunction move x2 (heap)");
+  return ebbrt::MakeReadyFuture<void>();
+}
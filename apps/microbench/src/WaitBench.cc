@@ -0,0 +1,70 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "Bench.h"
+
+#include <ebbrt/EventManager.h>
+
+ebbrt::Future<int> bench::AsyncValue(int val) {
+  ebbrt::Promise<int> p;
+  auto f = p.GetFuture();
+  ebbrt::event_manager->Spawn(
+      [ p = std::move(p), val ]() mutable { p.SetValue(val); },
+      /* force_async = */ true);
+  return f;
+}
+
+namespace {
+struct ThenWaits {
+  size_t left = bench::kWaits;
+  ebbrt::Promise<void> done;
+  ebbrt::clock::HighResTimer timer;
+};
+
+void NextThen(ThenWaits* waits) {
+  if (waits->left == 0) {
+    auto p = std::move(waits->done);
+    p.SetValue();
+    return;
+  }
+  --waits->left;
+  bench::AsyncValue(1).Then([waits](ebbrt::Future<int> f) {
+    bench::DoNotOptimize(f.Get());
+    NextThen(waits);
+  });
+}
+
+ebbrt::Future<void> ThenBench() {
+  auto waits = new ThenWaits;
+  auto ret = waits->done.GetFuture().Then([waits](ebbrt::Future<void> f) {
+    f.Get();
+    bench::Report("Wait for an async value with Then", bench::kWaits,
+                  waits->timer.tock());
+    delete waits;
+  });
+  waits->timer.tick();
+  NextThen(waits);
+  return ret;
+}
+
+// Must run in an event that may block
+void BlockBench() {
+  ebbrt::clock::HighResTimer timer;
+  timer.tick();
+  for (size_t i = 0; i < bench::kWaits; ++i) {
+    auto f = bench::AsyncValue(1);
+    f.Block();
+    bench::DoNotOptimize(f.Get());
+  }
+  bench::Report("Wait for an async value with Block", bench::kWaits,
+                timer.tock());
+}
+}  // namespace
+
+ebbrt::Future<void> bench::WaitBench() {
+  return ThenBench().Then([](ebbrt::Future<void> f) {
+    f.Get();
+    BlockBench();
+  });
+}
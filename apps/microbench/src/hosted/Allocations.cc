@@ -0,0 +1,40 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "../Bench.h"
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+}  // namespace
+
+// operator new, asio and boost all allocate through malloc, so interposing
+// on glibc's allocator counts every heap allocation the process makes
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+
+uint64_t bench::Allocations() {
+  return allocations.load(std::memory_order_relaxed);
+}
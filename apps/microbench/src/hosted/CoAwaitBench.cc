@@ -0,0 +1,30 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Built with C++20 coroutines enabled, see CMakeLists.txt
+#include <memory>
+
+#include <ebbrt/Coroutine.h>
+
+#include "../Bench.h"
+
+namespace {
+ebbrt::Task<void> AwaitValues(size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    bench::DoNotOptimize(co_await bench::AsyncValue(1));
+  }
+}
+}  // namespace
+
+ebbrt::Future<void> bench::CoAwaitBench() {
+  auto timer = std::make_shared<ebbrt::clock::HighResTimer>();
+  timer->tick();
+  return AwaitValues(kWaits).GetFuture().Then(
+      [timer](ebbrt::Future<void> f) {
+        f.Get();
+        Report("Wait for an async value with co_await", kWaits,
+               timer->tock());
+      });
+}
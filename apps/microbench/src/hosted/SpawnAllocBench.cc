@@ -0,0 +1,61 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include <array>
+
+#include <ebbrt/EventManager.h>
+
+#include "../Bench.h"
+
+namespace {
+const constexpr size_t kEvents = 100000;
+
+struct SpawnState {
+  const char* name;
+  size_t remaining;
+  // allocation count before the first spawn
+  uint64_t start;
+  ebbrt::Promise<void> done;
+};
+
+// Spawn kEvents events whose capture is a pointer plus Pad words, and count
+// the allocations made by the Spawn calls and by the events as a whole
+template <size_t Pad>
+ebbrt::Future<void> MeasureSpawn(const char* spawn_name,
+                                 const char* total_name) {
+  auto state = new SpawnState{total_name, kEvents, 0, {}};
+  auto f = state->done.GetFuture();
+  std::array<uint64_t, Pad> pad{};
+  state->start = bench::Allocations();
+  for (size_t i = 0; i < kEvents; ++i) {
+    ebbrt::event_manager->Spawn(
+        [state, pad]() {
+          bench::DoNotOptimize(pad);
+          if (--state->remaining > 0)
+            return;
+          bench::ReportAllocations(state->name, kEvents,
+                                   bench::Allocations() - state->start);
+          auto p = std::move(state->done);
+          delete state;
+          p.SetValue();
+        },
+        true);
+  }
+  // no event has run yet, the events are queued behind this one
+  bench::ReportAllocations(spawn_name, kEvents,
+                           bench::Allocations() - state->start);
+  return f;
+}
+}  // namespace
+
+ebbrt::Future<void> bench::SpawnAllocBench() {
+  // 3 words fit in a MovableFunction's inline buffer, 17 do not
+  return MeasureSpawn<2>("Spawn allocations, spawning (inline)",
+                         "Spawn allocations, spawn+run (inline)")
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return MeasureSpawn<16>("Spawn allocations, spawning (heap)",
+                                "Spawn allocations, spawn+run (heap)");
+      });
+}
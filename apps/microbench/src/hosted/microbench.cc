@@ -0,0 +1,47 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstdio>
+
+#include <ebbrt/Cpu.h>
+
+#include "../Bench.h"
+
+void AppMain() {
+  bench::MovableFunctionBench()
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::FutureChainBench();
+      })
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::WaitBench();
+      })
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::SpawnAllocBench();
+      })
+#ifdef MICROBENCH_COAWAIT
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::CoAwaitBench();
+      })
+#endif
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        std::printf("Microbenchmarks complete\n");
+        ebbrt::Cpu::Exit(0);
+      });
+}
+
+int main(int argc, char** argv) {
+  void* status;
+
+  pthread_t tid = ebbrt::Cpu::EarlyInit(1);
+  pthread_join(tid, &status);
+
+  ebbrt::Cpu::Exit(0);
+  return 0;
+}
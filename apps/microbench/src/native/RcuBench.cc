@@ -0,0 +1,116 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "../Bench.h"
+
+#include <atomic>
+
+#include <ebbrt/Cpu.h>
+#include <ebbrt/EventManager.h>
+#include <ebbrt/native/Rcu.h>
+
+namespace {
+const constexpr size_t kGracePeriods = 1000;
+const constexpr size_t kCallbacksPerCore = 10000;
+
+// Grace periods waited for one after the other. An event blocked on a grace
+// period would keep its core from ever becoming quiescent, so each wait is a
+// continuation
+struct GracePeriods {
+  GracePeriods(const char* name, bool expedited)
+      : name(name), left(kGracePeriods), expedited(expedited) {}
+
+  const char* name;
+  size_t left;
+  bool expedited;
+  ebbrt::Promise<void> done;
+  ebbrt::clock::HighResTimer timer;
+};
+
+void NextGracePeriod(GracePeriods* gps) {
+  if (gps->left == 0) {
+    auto p = std::move(gps->done);
+    p.SetValue();
+    return;
+  }
+  --gps->left;
+  auto f = gps->expedited ? ebbrt::SynchronizeRcuExpedited()
+                          : ebbrt::CallRcu([]() {});
+  f.Then([gps](ebbrt::Future<void> f) {
+    f.Get();
+    NextGracePeriod(gps);
+  });
+}
+
+ebbrt::Future<void> GracePeriodBench(const char* name, bool expedited) {
+  auto gps = new GracePeriods(name, expedited);
+  auto ret = gps->done.GetFuture().Then([gps](ebbrt::Future<void> f) {
+    f.Get();
+    bench::Report(gps->name, kGracePeriods, gps->timer.tock());
+    delete gps;
+  });
+  gps->timer.tick();
+  NextGracePeriod(gps);
+  return ret;
+}
+
+// Every core queues a burst of callbacks at once, so grace periods are
+// driven by all cores reporting through the combining tree
+struct CallbackBurst {
+  explicit CallbackBurst(size_t home)
+      : remaining(kCallbacksPerCore * ebbrt::Cpu::Count()), home(home) {}
+
+  std::atomic<size_t> remaining;
+  size_t home;
+  ebbrt::Promise<void> done;
+  ebbrt::clock::HighResTimer timer;
+};
+
+ebbrt::Future<void> CallbackBurstBench(size_t home) {
+  auto burst = new CallbackBurst(home);
+  auto total = kCallbacksPerCore * ebbrt::Cpu::Count();
+  auto ret =
+      burst->done.GetFuture().Then([burst, total](ebbrt::Future<void> f) {
+        f.Get();
+        bench::Report("RCU callbacks queued on every core", total,
+                      burst->timer.tock());
+        delete burst;
+      });
+  burst->timer.tick();
+  for (size_t cpu = 0; cpu < ebbrt::Cpu::Count(); ++cpu) {
+    ebbrt::event_manager->SpawnRemote(
+        [burst]() {
+          for (size_t i = 0; i < kCallbacksPerCore; ++i) {
+            ebbrt::event_manager->DoRcu([burst]() {
+              if (burst->remaining.fetch_sub(1) != 1)
+                return;
+              // finish on the core that started the timer
+              ebbrt::event_manager->SpawnRemote(
+                  [burst]() {
+                    auto p = std::move(burst->done);
+                    p.SetValue();
+                  },
+                  burst->home);
+            });
+          }
+        },
+        cpu);
+  }
+  return ret;
+}
+}  // namespace
+
+ebbrt::Future<void> bench::RcuBench() {
+  size_t home = ebbrt::Cpu::GetMine();
+  return GracePeriodBench("RCU grace period", /* expedited = */ false)
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return GracePeriodBench("RCU grace period (expedited)",
+                                /* expedited = */ true);
+      })
+      .Then([home](ebbrt::Future<void> f) {
+        f.Get();
+        return CallbackBurstBench(home);
+      });
+}
@@ -0,0 +1,120 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "../Bench.h"
+
+#include <ebbrt/Cpu.h>
+#include <ebbrt/Debug.h>
+#include <ebbrt/EventManager.h>
+
+namespace {
+const constexpr size_t kTasks = 100000;
+const constexpr size_t kRoundTrips = 100000;
+
+// A batch of empty tasks all run on one core, the last one to run completes
+// the benchmark
+struct TaskBatch {
+  explicit TaskBatch(size_t tasks) : remaining(tasks) {}
+
+  void Run() {
+    if (--remaining == 0) {
+      // the continuation frees the batch, so fulfil a promise it doesn't own
+      auto p = std::move(done);
+      p.SetValue();
+    }
+  }
+
+  ebbrt::Future<void> Finish(const char* name, size_t tasks) {
+    return done.GetFuture().Then([this, name, tasks](ebbrt::Future<void> f) {
+      f.Get();
+      bench::Report(name, tasks, timer.tock());
+      delete this;
+    });
+  }
+
+  size_t remaining;
+  ebbrt::Promise<void> done;
+  ebbrt::clock::HighResTimer timer;
+};
+
+ebbrt::Future<void> SpawnLocalBench() {
+  auto batch = new TaskBatch(kTasks);
+  auto ret = batch->Finish("SpawnLocal async", kTasks);
+  batch->timer.tick();
+  for (size_t i = 0; i < kTasks; ++i) {
+    ebbrt::event_manager->SpawnLocal([batch]() { batch->Run(); },
+                                     /* force_async = */ true);
+  }
+  return ret;
+}
+
+// Every other core spawns its share of the tasks onto home
+ebbrt::Future<void> SpawnRemoteManyToOneBench(size_t home) {
+  auto producers = ebbrt::Cpu::Count() - 1;
+  auto batch = new TaskBatch(kTasks * producers);
+  auto ret = batch->Finish("SpawnRemote all cores to one", kTasks * producers);
+  batch->timer.tick();
+  for (size_t cpu = 0; cpu < ebbrt::Cpu::Count(); ++cpu) {
+    if (cpu == home)
+      continue;
+    ebbrt::event_manager->SpawnRemote(
+        [batch, home]() {
+          for (size_t i = 0; i < kTasks; ++i) {
+            ebbrt::event_manager->SpawnRemote([batch]() { batch->Run(); },
+                                              home);
+          }
+        },
+        cpu);
+  }
+  return ret;
+}
+
+struct RoundTrips {
+  ebbrt::Promise<void> done;
+  ebbrt::clock::HighResTimer timer;
+};
+
+// Bounce an event between two cores, a round trip is two SpawnRemotes
+void RoundTrip(size_t left, size_t home, size_t peer, RoundTrips* trips) {
+  if (left == 0) {
+    auto p = std::move(trips->done);
+    p.SetValue();
+    return;
+  }
+  ebbrt::event_manager->SpawnRemote(
+      [=]() {
+        ebbrt::event_manager->SpawnRemote(
+            [=]() { RoundTrip(left - 1, home, peer, trips); }, home);
+      },
+      peer);
+}
+
+ebbrt::Future<void> SpawnRemoteRoundTripBench(size_t home) {
+  auto trips = new RoundTrips;
+  auto ret = trips->done.GetFuture().Then([trips](ebbrt::Future<void> f) {
+    f.Get();
+    bench::Report("SpawnRemote round trip", kRoundTrips, trips->timer.tock());
+    delete trips;
+  });
+  trips->timer.tick();
+  RoundTrip(kRoundTrips, home, (home + 1) % ebbrt::Cpu::Count(), trips);
+  return ret;
+}
+}  // namespace
+
+ebbrt::Future<void> bench::SpawnBench() {
+  size_t home = ebbrt::Cpu::GetMine();
+  return SpawnLocalBench().Then([home](ebbrt::Future<void> f) {
+    f.Get();
+    if (ebbrt::Cpu::Count() < 2) {
+      ebbrt::kprintf("Skipping cross core spawn benchmarks on one core\n");
+      return ebbrt::MakeReadyFuture<void>();
+    }
+    return SpawnRemoteRoundTripBench(home).Then(
+        [home](ebbrt::Future<void> f) {
+          f.Get();
+          return SpawnRemoteManyToOneBench(home);
+        });
+  });
+}
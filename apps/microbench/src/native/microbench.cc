@@ -0,0 +1,35 @@
+//          Copyright Boston University SESA Group 2013 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <ebbrt/Cpu.h>
+#include <ebbrt/Debug.h>
+
+#include "../Bench.h"
+
+void AppMain() {
+  ebbrt::kprintf("Running microbenchmarks on %llu cores\n",
+                 static_cast<unsigned long long>(ebbrt::Cpu::Count()));
+  bench::MovableFunctionBench()
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::FutureChainBench();
+      })
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::WaitBench();
+      })
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::SpawnBench();
+      })
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        return bench::RcuBench();
+      })
+      .Then([](ebbrt::Future<void> f) {
+        f.Get();
+        ebbrt::kprintf("Microbenchmarks complete\n");
+      });
+}
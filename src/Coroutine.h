@@ -0,0 +1,224 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef COMMON_SRC_INCLUDE_EBBRT_COROUTINE_H_
+#define COMMON_SRC_INCLUDE_EBBRT_COROUTINE_H_
+
+// co_await support for Future and SharedFuture. Unlike Block(), awaiting a
+// future does not save the event's stack; the coroutine frame is suspended and
+// later resumed on the hosted Context that awaited.
+//
+// Hosted only. The native toolchain is GCC 5.3 (toolchain/Makefile), which
+// has no coroutine support, so native applications must keep using Then or
+// Block. The hosted runtime itself is built as C++14, this header requires
+// the including translation unit to be built with C++20 coroutines enabled
+// (GCC 10 or later with -std=c++2a -fcoroutines), see apps/microbench.
+#ifdef __ebbrt__
+#error "Coroutine.h is hosted only, the native toolchain has no coroutines"
+#endif
+#if !defined(__cpp_impl_coroutine)
+#error "Coroutine.h requires a compiler with C++20 coroutine support"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "Cpu.h"
+#include "EventManager.h"
+#include "Future.h"
+
+namespace ebbrt {
+namespace __coroutine_detail {
+// Resumes a suspended coroutine as an event on the Context that suspended it
+class Resumer {
+ public:
+  explicit Resumer(std::coroutine_handle<> handle)
+      : handle_(handle), context_(active_context) {}
+
+  void operator()() const {
+    if (active_context == context_) {
+      handle_.resume();
+    } else {
+      auto handle = handle_;
+      event_manager->SpawnRemote([handle]() { handle.resume(); }, context_);
+    }
+  }
+
+ private:
+  std::coroutine_handle<> handle_;
+  Context* context_;
+};
+
+// Shared suspension logic. The continuation may run (possibly on another
+// thread) before await_suspend has finished installing it, in which case the
+// coroutine must not be resumed from the continuation, await_suspend returns
+// false instead and the coroutine carries on.
+class AwaiterBase {
+ protected:
+  enum { kSuspending, kSuspended, kReady };
+
+  bool Suspended() { return state_.exchange(kSuspended) != kReady; }
+
+  void Complete(const Resumer& resumer) {
+    if (state_.exchange(kReady) == kSuspending)
+      return;
+    resumer();
+  }
+
+ private:
+  std::atomic<int> state_{kSuspending};
+};
+
+template <typename T> class FutureAwaiter : AwaiterBase {
+ public:
+  explicit FutureAwaiter(Future<T>&& fut) : fut_(std::move(fut)) {}
+
+  bool await_ready() const { return fut_.Ready(); }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    fut_.Then([this, resumer = Resumer(handle)](Future<T> fut) {
+      fut_ = std::move(fut);
+      Complete(resumer);
+    });
+    return Suspended();
+  }
+
+  T await_resume() { return std::move(fut_.Get()); }
+
+ private:
+  Future<T> fut_;
+};
+
+template <> class FutureAwaiter<void> : AwaiterBase {
+ public:
+  explicit FutureAwaiter(Future<void>&& fut) : fut_(std::move(fut)) {}
+
+  bool await_ready() const { return fut_.Ready(); }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    fut_.Then([this, resumer = Resumer(handle)](Future<void> fut) {
+      fut_ = std::move(fut);
+      Complete(resumer);
+    });
+    return Suspended();
+  }
+
+  void await_resume() { fut_.Get(); }
+
+ private:
+  Future<void> fut_;
+};
+
+template <typename T> class SharedFutureAwaiter : AwaiterBase {
+ public:
+  explicit SharedFutureAwaiter(SharedFuture<T> fut) : fut_(std::move(fut)) {}
+
+  bool await_ready() const { return fut_.Ready(); }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    fut_.Then([this, resumer = Resumer(handle)](SharedFuture<T> fut) {
+      Complete(resumer);
+    });
+    return Suspended();
+  }
+
+  T& await_resume() { return fut_.Get(); }
+
+ private:
+  SharedFuture<T> fut_;
+};
+
+template <> class SharedFutureAwaiter<void> : AwaiterBase {
+ public:
+  explicit SharedFutureAwaiter(SharedFuture<void> fut)
+      : fut_(std::move(fut)) {}
+
+  bool await_ready() const { return fut_.Ready(); }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    fut_.Then([this, resumer = Resumer(handle)](SharedFuture<void> fut) {
+      Complete(resumer);
+    });
+    return Suspended();
+  }
+
+  void await_resume() { fut_.Get(); }
+
+ private:
+  SharedFuture<void> fut_;
+};
+
+template <typename T> class TaskPromiseBase {
+ public:
+  std::suspend_never initial_suspend() noexcept { return {}; }
+  std::suspend_never final_suspend() noexcept { return {}; }
+  void unhandled_exception() {
+    promise_.SetException(std::current_exception());
+  }
+
+ protected:
+  Promise<T> promise_;
+};
+}  // namespace __coroutine_detail
+
+template <typename T>
+__coroutine_detail::FutureAwaiter<T> operator co_await(Future<T>&& fut) {
+  return __coroutine_detail::FutureAwaiter<T>(std::move(fut));
+}
+
+template <typename T>
+__coroutine_detail::SharedFutureAwaiter<T>
+operator co_await(SharedFuture<T> fut) {
+  return __coroutine_detail::SharedFutureAwaiter<T>(std::move(fut));
+}
+
+// The return type of a coroutine. The coroutine starts running immediately
+// in the calling event, its result is delivered through a Future so a Task
+// can be co_awaited or chained with Then.
+template <typename T> class Task {
+ public:
+  class promise_type : public __coroutine_detail::TaskPromiseBase<T> {
+   public:
+    Task get_return_object() { return Task(this->promise_.GetFuture()); }
+    template <typename U> void return_value(U&& val) {
+      this->promise_.SetValue(std::forward<U>(val));
+    }
+  };
+
+  Future<T> GetFuture() { return std::move(fut_); }
+
+  __coroutine_detail::FutureAwaiter<T> operator co_await() && {
+    return __coroutine_detail::FutureAwaiter<T>(std::move(fut_));
+  }
+
+ private:
+  explicit Task(Future<T> fut) : fut_(std::move(fut)) {}
+
+  Future<T> fut_;
+};
+
+template <> class Task<void> {
+ public:
+  class promise_type : public __coroutine_detail::TaskPromiseBase<void> {
+   public:
+    Task get_return_object() { return Task(promise_.GetFuture()); }
+    void return_void() { promise_.SetValue(); }
+  };
+
+  Future<void> GetFuture() { return std::move(fut_); }
+
+  __coroutine_detail::FutureAwaiter<void> operator co_await() && {
+    return __coroutine_detail::FutureAwaiter<void>(std::move(fut_));
+  }
+
+ private:
+  explicit Task(Future<void> fut) : fut_(std::move(fut)) {}
+
+  Future<void> fut_;
+};
+}  // namespace ebbrt
+
+#endif  // COMMON_SRC_INCLUDE_EBBRT_COROUTINE_H_
@@ -6,22 +6,29 @@
 #define COMMON_SRC_INCLUDE_EBBRT_FUTURE_H_
 
 #include <atomic>
+#include <chrono>
 #include <exception>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <stdexcept>
 #include <string>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "Cpu.h"
 #include "EventManager.h"
 #include "ExplicitlyConstructed.h"
 #include "MoveLambda.h"
+#include "Timer.h"
 
 namespace ebbrt {
 template <typename Res> class Future;
 template <typename Res> class SharedFuture;
 template <typename Res> class Promise;
+class CancellationToken;
 
 enum class Launch { Sync, Async };
 
@@ -32,6 +39,22 @@ struct UnreadyFutureError : public std::logic_error {
       : std::logic_error{what_arg} {}
 };
 
+// The future's promise was cancelled through its CancellationToken
+struct CancelledError : public std::runtime_error {
+  explicit CancelledError(const std::string& what_arg)
+      : std::runtime_error{what_arg} {}
+  explicit CancelledError(const char* what_arg)
+      : std::runtime_error{what_arg} {}
+};
+
+// Future::WithTimeout expired before the future became ready
+struct TimeoutError : public std::runtime_error {
+  explicit TimeoutError(const std::string& what_arg)
+      : std::runtime_error{what_arg} {}
+  explicit TimeoutError(const char* what_arg)
+      : std::runtime_error{what_arg} {}
+};
+
 template <typename T, typename... Args>
 Future<T> MakeReadyFuture(Args&&... args);
 
@@ -52,6 +75,9 @@ struct MakeReadyFutureTag {};
 
 struct ExceptionPtrWrapper {
   std::exception_ptr eptr_;
+  // set once Get has rethrown the exception, only an exception nobody looked
+  // at is rethrown on destruction
+  bool observed_ = false;
   ExceptionPtrWrapper() = default;
   explicit ExceptionPtrWrapper(std::exception_ptr ptr)
       : eptr_(std::move(ptr)) {}
@@ -60,18 +86,40 @@ struct ExceptionPtrWrapper {
   ExceptionPtrWrapper& operator=(ExceptionPtrWrapper&&) = default;
   ExceptionPtrWrapper(ExceptionPtrWrapper&& other) = default;
   virtual ~ExceptionPtrWrapper() {
-    if (eptr_) {
+    if (eptr_ && !observed_) {
       std::rethrow_exception(eptr_);
     }
   }
 };
 
+// Runs a continuation against a future that is already ready, shared by
+// State::Then and the Then of a future holding its value inline
+template <typename F, typename R>
+typename std::enable_if<
+    !std::is_void<typename std::result_of<F(R)>::type>::value,
+    Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
+ThenReady(Launch policy, F&& func, R fut);
+
+template <typename F, typename R>
+typename std::enable_if<
+    std::is_void<typename std::result_of<F(R)>::type>::value,
+    Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
+ThenReady(Launch policy, F&& func, R fut);
+
+// A state starts out pending. Installing a continuation with Then moves it to
+// kContinuation and fulfilling the promise moves it to kReady, whichever
+// happens second runs the continuation. No lock is needed. A promise may be
+// raced by a cancellation, so fulfilling it first claims the state and only
+// the winner writes the result.
+enum : uint8_t { kPending, kContinuation, kReady };
+
 template <typename Res> class State {
   Res val_;
   ExceptionPtrWrapper eptr_;
   MovableFunction<void()> func_;
-  std::atomic_bool ready_;
-  std::mutex mutex_;
+  std::atomic<uint8_t> status_;
+  // set by the first SetValue/SetException, later ones are dropped
+  std::atomic_bool claimed_;
 
  public:
   State();
@@ -89,11 +137,17 @@ template <typename Res> class State {
 
   void SetException(std::exception_ptr eptr);
 
+  void Cancel();
+
   Res& Get();
 
   bool Ready() const;
 
  private:
+  bool Claim();
+  bool SetContinuation();
+  void Fulfil();
+
   // Non void return then
   template <typename F, typename R>
   typename std::enable_if<
@@ -112,8 +166,8 @@ template <typename Res> class State {
 template <> class State<void> {
   ExceptionPtrWrapper eptr_;
   MovableFunction<void()> func_;
-  std::atomic_bool ready_;
-  std::mutex mutex_;
+  std::atomic<uint8_t> status_;
+  std::atomic_bool claimed_;
 
  public:
   State();
@@ -130,11 +184,17 @@ template <> class State<void> {
 
   void SetException(std::exception_ptr eptr);
 
+  void Cancel();
+
   void Get();
 
   bool Ready() const;
 
  private:
+  bool Claim();
+  bool SetContinuation();
+  void Fulfil();
+
   // Non void return then
   template <typename F, typename R>
   typename std::enable_if<
@@ -155,15 +215,20 @@ template <typename Res> class Future {
   typedef __future_detail::State<Res> State;
 
   std::shared_ptr<State> state_;
+  // A future that is ready on construction (MakeReadyFuture) holds its value
+  // inline instead of allocating a shared state
+  bool inline_ready_{false};
+  typename std::aligned_storage<sizeof(Res), alignof(Res)>::type val_;
 
  public:
   Future() = default;
+  ~Future();
 
   Future(const Future&) = delete;
   Future& operator=(const Future&) = delete;
 
-  Future(Future&&) = default;
-  Future& operator=(Future&&) = default;
+  Future(Future&&);
+  Future& operator=(Future&&);
 
   SharedFuture<Res> Share();
 
@@ -183,9 +248,16 @@ template <typename Res> class Future {
 
   Future<Res> Block();
 
+  // A future that fails with TimeoutError unless this one becomes ready
+  // within timeout. This future is consumed as if by Then.
+  Future<Res> WithTimeout(std::chrono::microseconds timeout);
+
   typedef typename std::decay<Res>::type value_type;
 
  private:
+  Res& InlineValue();
+  void Reset();
+
   friend class Promise<Res>;
   template <typename T, typename... Args>
   friend Future<T> MakeReadyFuture(Args&&... args);
@@ -204,6 +276,8 @@ template <> class Future<void> {
   typedef __future_detail::State<void> State;
 
   std::shared_ptr<State> state_;
+  // Set by MakeReadyFuture, no shared state is allocated
+  bool inline_ready_{false};
 
  public:
   Future() = default;
@@ -211,8 +285,8 @@ template <> class Future<void> {
   Future(const Future&) = delete;
   Future& operator=(const Future&) = delete;
 
-  Future(Future&&) = default;
-  Future& operator=(Future&&) = default;
+  Future(Future&&);
+  Future& operator=(Future&&);
 
   SharedFuture<void> Share();
 
@@ -232,6 +306,8 @@ template <> class Future<void> {
 
   Future<void> Block();
 
+  Future<void> WithTimeout(std::chrono::microseconds timeout);
+
   typedef void value_type;
 
  private:
@@ -347,6 +423,10 @@ template <typename Res> class Promise {
 
   void SetException(std::exception_ptr);
 
+  // If token is cancelled before the promise is fulfilled the future fails
+  // with CancelledError and later attempts to fulfil it are ignored
+  void SetCancellationToken(const CancellationToken& token);
+
   Future<Res> GetFuture();
 };
 
@@ -368,9 +448,162 @@ template <> class Promise<void> {
 
   void SetException(std::exception_ptr);
 
+  void SetCancellationToken(const CancellationToken& token);
+
   Future<void> GetFuture();
 };
 
+namespace __future_detail {
+class CancellationState {
+ public:
+  bool Cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+  void Cancel() {
+    std::vector<MovableFunction<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (cancelled_.exchange(true, std::memory_order_release))
+        return;
+      callbacks.swap(callbacks_);
+    }
+    for (auto& callback : callbacks)
+      callback();
+  }
+
+  void OnCancel(MovableFunction<void()> func) {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (!Cancelled()) {
+        callbacks_.emplace_back(std::move(func));
+        return;
+      }
+    }
+    func();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::atomic_bool cancelled_{false};
+  std::vector<MovableFunction<void()>> callbacks_;
+};
+}  // namespace __future_detail
+
+// Cooperative cancellation. Whoever wants work abandoned holds the
+// CancellationSource, the work holds tokens which it can poll, subscribe to or
+// attach to the promises it will fulfil.
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+
+  bool IsCancelled() const { return state_ && state_->Cancelled(); }
+
+  // Run func when cancellation is requested, immediately if it already was
+  void OnCancel(MovableFunction<void()> func) const {
+    if (state_)
+      state_->OnCancel(std::move(func));
+  }
+
+ private:
+  explicit CancellationToken(
+      std::shared_ptr<__future_detail::CancellationState> state)
+      : state_{std::move(state)} {}
+
+  std::shared_ptr<__future_detail::CancellationState> state_;
+
+  friend class CancellationSource;
+};
+
+class CancellationSource {
+ public:
+  CancellationSource()
+      : state_{std::make_shared<__future_detail::CancellationState>()} {}
+
+  CancellationToken GetToken() const { return CancellationToken{state_}; }
+
+  // Callbacks registered on the tokens run synchronously in this event
+  void Cancel() { state_->Cancel(); }
+
+  bool IsCancelled() const { return state_->Cancelled(); }
+
+ private:
+  std::shared_ptr<__future_detail::CancellationState> state_;
+};
+
+namespace __future_detail {
+template <typename T> void ForwardResult(Future<T>& fut, Promise<T>& promise) {
+  try {
+    promise.SetValue(std::move(fut.Get()));
+  } catch (...) {
+    promise.SetException(std::current_exception());
+  }
+}
+
+inline void ForwardResult(Future<void>& fut, Promise<void>& promise) {
+  try {
+    fut.Get();
+    promise.SetValue();
+  } catch (...) {
+    promise.SetException(std::current_exception());
+  }
+}
+
+// Races a timer against a future for WithTimeout. It is referenced by the
+// armed timer and by the future's continuation and is freed once both are
+// done with it. A timer can only be stopped on the core that started it, a
+// continuation that runs elsewhere leaves the timer to fire harmlessly.
+template <typename Res> class TimeoutHook : public Timer::Hook {
+ public:
+  explicit TimeoutHook(Promise<Res> promise)
+      : promise_(std::move(promise))
+#ifdef __ebbrt__
+        ,
+        cpu_(Cpu::GetMine())
+#endif
+  {
+  }
+
+  void Fire() override {
+    if (!done_.exchange(true)) {
+      promise_.SetException(
+          std::make_exception_ptr(TimeoutError("Future timed out")));
+    }
+    Release();
+  }
+
+  void Complete(Future<Res> fut) {
+    if (!done_.exchange(true)) {
+      ForwardResult(fut, promise_);
+    } else {
+      // too late, but a failure must not be reported as unhandled
+      try {
+        fut.Get();
+      } catch (...) {
+      }
+    }
+#ifdef __ebbrt__
+    if (static_cast<size_t>(Cpu::GetMine()) == cpu_ && is_linked()) {
+      timer->Stop(*this);
+      Release();
+    }
+#endif
+    Release();
+  }
+
+ private:
+  void Release() {
+    if (refs_.fetch_sub(1) == 1)
+      delete this;
+  }
+
+  Promise<Res> promise_;
+  std::atomic_bool done_{false};
+  std::atomic<int> refs_{2};
+#ifdef __ebbrt__
+  size_t cpu_;
+#endif
+};
+}  // namespace __future_detail
+
 template <typename T, typename... Args>
 Future<T> MakeReadyFuture(Args&&... args) {
   return Future<T>{typename __future_detail::MakeReadyFutureTag(),
@@ -515,6 +748,103 @@ Future<std::vector<T>> when_all(std::vector<Future<T>>& vec) {
   return std::move(ret);
 }
 
+namespace __future_detail {
+// WhenAny of void futures has no value to report, only the index
+template <typename T> struct WhenAnyResult {
+  typedef std::pair<size_t, T> type;
+};
+
+template <> struct WhenAnyResult<void> { typedef size_t type; };
+
+template <typename T> struct WhenAnyState {
+  explicit WhenAnyState(size_t count) : failures_left{count} {}
+
+  std::atomic_bool done{false};
+  std::atomic_size_t failures_left;
+  Promise<typename WhenAnyResult<T>::type> promise;
+};
+
+template <typename T, typename F>
+void WhenAnySucceed(WhenAnyState<T>& state, size_t index, F& val,
+                    std::false_type /* void */) {
+  auto& v = val.Get();
+  if (!state.done.exchange(true))
+    state.promise.SetValue(std::make_pair(index, std::move(v)));
+}
+
+template <typename T, typename F>
+void WhenAnySucceed(WhenAnyState<T>& state, size_t index, F& val,
+                    std::true_type /* void */) {
+  val.Get();
+  if (!state.done.exchange(true))
+    state.promise.SetValue(index);
+}
+
+template <typename T, typename F>
+void WhenAnyAdd(const std::shared_ptr<WhenAnyState<T>>& state, size_t index,
+                F&& f) {
+  f.Then([state, index](typename std::decay<F>::type val) {
+    try {
+      WhenAnySucceed(*state, index, val, std::is_void<T>());
+    } catch (...) {
+      if (state->failures_left.fetch_sub(1) == 1 && !state->done.exchange(true))
+        // every future failed, report the last failure
+        state->promise.SetException(std::current_exception());
+    }
+  });
+}
+
+template <typename T>
+void WhenAnyHelper(const std::shared_ptr<WhenAnyState<T>>&, size_t) {}
+
+template <typename T, typename T0, typename... Ts>
+void WhenAnyHelper(const std::shared_ptr<WhenAnyState<T>>& state, size_t index,
+                   T0&& f, Ts&&... futures) {
+  WhenAnyAdd(state, index, std::forward<T0>(f));
+  WhenAnyHelper(state, index + 1, std::forward<Ts>(futures)...);
+}
+}  // namespace __future_detail
+
+// Resolves with the index and value of the first future to succeed, so
+// replicas can be raced. For futures of void it resolves with just the index.
+// It only fails, with the last exception, if every future fails.
+template <typename InputIterator>
+typename std::enable_if<
+    !IsFutureType<InputIterator>::value,
+    Future<typename __future_detail::WhenAnyResult<
+        typename InputIterator::value_type::value_type>::type>>::type
+WhenAny(InputIterator first, InputIterator last) {
+  typedef typename InputIterator::value_type::value_type value_type;
+  auto length = std::distance(first, last);
+  if (length == 0) {
+    return MakeFailedFuture<
+        typename __future_detail::WhenAnyResult<value_type>::type>(
+        std::make_exception_ptr(std::invalid_argument("WhenAny of nothing")));
+  }
+  auto state =
+      std::make_shared<__future_detail::WhenAnyState<value_type>>(length);
+  auto ret = state->promise.GetFuture();
+  for (size_t i = 0; first != last; ++first, ++i) {
+    __future_detail::WhenAnyAdd(state, i, *first);
+  }
+  return ret;
+}
+
+template <typename T0, typename... T>
+Future<typename std::enable_if<
+    AreSame<typename T0::value_type, typename T::value_type...>::value,
+    typename __future_detail::WhenAnyResult<
+        typename std::decay<typename T0::value_type>::type>::type>::type>
+WhenAny(T0&& f, T&&... futures) {
+  typedef typename std::decay<typename T0::value_type>::type value_type;
+  auto state = std::make_shared<__future_detail::WhenAnyState<value_type>>(
+      sizeof...(T) + 1);
+  auto ret = state->promise.GetFuture();
+  __future_detail::WhenAnyHelper(state, 0, std::forward<T0>(f),
+                                 std::forward<T>(futures)...);
+  return ret;
+}
+
 template <typename Res>
 Future<typename Flatten<Res>::type> flatten(Future<Res> fut) {
   return std::move(fut);
@@ -522,6 +852,15 @@ Future<typename Flatten<Res>::type> flatten(Future<Res> fut) {
 
 template <typename Res>
 Future<typename Flatten<Res>::type> flatten(Future<Future<Res>> fut) {
+  if (fut.Ready()) {
+    // unwrap directly rather than chaining through another promise
+    try {
+      return flatten(std::move(fut.Get()));
+    } catch (...) {
+      return MakeFailedFuture<typename Flatten<Res>::type>(
+          std::current_exception());
+    }
+  }
   auto p = Promise<Res>();
   auto ret = p.GetFuture();
   fut.Then([prom = std::move(p)](Future<Future<Res>> fut) mutable {
@@ -545,6 +884,13 @@ Future<typename Flatten<Res>::type> flatten(Future<Future<Res>> fut) {
 }
 
 inline Future<void> flatten(Future<Future<void>> fut) {
+  if (fut.Ready()) {
+    try {
+      return std::move(fut.Get());
+    } catch (...) {
+      return MakeFailedFuture<void>(std::current_exception());
+    }
+  }
   auto p = Promise<void>();
   auto ret = p.GetFuture();
   fut.Then([prom = std::move(p)](Future<Future<void>> fut) mutable {
@@ -629,10 +975,60 @@ inline Future<void>::Future(
 template <typename Res>
 template <typename... Args>
 Future<Res>::Future(__future_detail::MakeReadyFutureTag tag, Args&&... args)
-    : state_{std::make_shared<State>(tag, std::forward<Args>(args)...)} {}
+    : inline_ready_{true} {
+  ::new (&val_) Res(std::forward<Args>(args)...);
+}
 
 inline Future<void>::Future(__future_detail::MakeReadyFutureTag tag)
-    : state_{std::make_shared<State>(tag)} {}
+    : inline_ready_{true} {}
+
+template <typename Res> Future<Res>::~Future() { Reset(); }
+
+template <typename Res>
+Future<Res>::Future(Future&& other)
+    : state_{std::move(other.state_)} {
+  if (other.inline_ready_) {
+    ::new (&val_) Res(std::move(other.InlineValue()));
+    inline_ready_ = true;
+    other.Reset();
+  }
+}
+
+inline Future<void>::Future(Future&& other)
+    : state_{std::move(other.state_)}, inline_ready_{other.inline_ready_} {
+  other.inline_ready_ = false;
+}
+
+template <typename Res> Future<Res>& Future<Res>::operator=(Future&& other) {
+  if (this == &other)
+    return *this;
+  Reset();
+  state_ = std::move(other.state_);
+  if (other.inline_ready_) {
+    ::new (&val_) Res(std::move(other.InlineValue()));
+    inline_ready_ = true;
+    other.Reset();
+  }
+  return *this;
+}
+
+inline Future<void>& Future<void>::operator=(Future&& other) {
+  state_ = std::move(other.state_);
+  inline_ready_ = other.inline_ready_;
+  other.inline_ready_ = false;
+  return *this;
+}
+
+template <typename Res> Res& Future<Res>::InlineValue() {
+  return *reinterpret_cast<Res*>(&val_);
+}
+
+template <typename Res> void Future<Res>::Reset() {
+  if (inline_ready_) {
+    InlineValue().~Res();
+    inline_ready_ = false;
+  }
+}
 
 template <typename Res>
 Future<Res>::Future(std::exception_ptr eptr)
@@ -642,10 +1038,20 @@ inline Future<void>::Future(std::exception_ptr eptr)
     : state_{std::make_shared<State>(std::move(eptr))} {}
 
 template <typename Res> SharedFuture<Res> Future<Res>::Share() {
+  if (inline_ready_) {
+    // a shared future needs a state to share
+    state_ = std::make_shared<State>(__future_detail::MakeReadyFutureTag(),
+                                     std::move(InlineValue()));
+    Reset();
+  }
   return SharedFuture<Res>(std::move(state_));
 }
 
 inline SharedFuture<void> Future<void>::Share() {
+  if (inline_ready_) {
+    state_ = std::make_shared<State>(__future_detail::MakeReadyFutureTag());
+    inline_ready_ = false;
+  }
   return SharedFuture<void>(std::move(state_));
 }
 
@@ -698,6 +1104,9 @@ template <typename Res>
 template <typename F>
 Future<typename Flatten<typename std::result_of<F(Future<Res>)>::type>::type>
 Future<Res>::Then(Launch policy, F&& func) {
+  if (inline_ready_)
+    return __future_detail::ThenReady(policy, std::forward<F>(func),
+                                      std::move(*this));
   auto& state = *state_;
   return state.Then(policy, std::forward<F>(func), std::move(*this));
 }
@@ -705,6 +1114,9 @@ Future<Res>::Then(Launch policy, F&& func) {
 template <typename F>
 Future<typename Flatten<typename std::result_of<F(Future<void>)>::type>::type>
 Future<void>::Then(Launch policy, F&& func) {
+  if (inline_ready_)
+    return __future_detail::ThenReady(policy, std::forward<F>(func),
+                                      std::move(*this));
   auto& state = *state_;
   return state.Then(policy, std::forward<F>(func), std::move(*this));
 }
@@ -722,18 +1134,28 @@ Future<void>::Then(F&& func) {
   return Then(Launch::Sync, std::forward<F>(func));
 }
 
-template <typename Res> Res& Future<Res>::Get() { return state_->Get(); }
+template <typename Res> Res& Future<Res>::Get() {
+  if (inline_ready_)
+    return InlineValue();
+  return state_->Get();
+}
 
-inline void Future<void>::Get() { state_->Get(); }
+inline void Future<void>::Get() {
+  if (inline_ready_)
+    return;
+  state_->Get();
+}
 
 template <typename Res> bool Future<Res>::Ready() const {
-  return state_->Ready();
+  return inline_ready_ || state_->Ready();
 }
 
-inline bool Future<void>::Ready() const { return state_->Ready(); }
+inline bool Future<void>::Ready() const {
+  return inline_ready_ || state_->Ready();
+}
 
 inline Future<void> Future<void>::Block() { 
- if (state_->Ready())
+ if (Ready())
    return std::move(*this);
 
  ebbrt::EventManager::EventContext context;
@@ -785,11 +1207,39 @@ template <typename Res> bool SharedFuture<Res>::Ready() const {
   return state_->Ready();
 }
 
+template <typename Res>
+Future<Res> Future<Res>::WithTimeout(std::chrono::microseconds timeout) {
+  if (Ready())
+    return std::move(*this);
+
+  Promise<Res> promise;
+  auto ret = promise.GetFuture();
+  auto hook = new __future_detail::TimeoutHook<Res>(std::move(promise));
+  timer->Start(*hook, timeout, /* repeat = */ false);
+  Then([hook](Future<Res> fut) { hook->Complete(std::move(fut)); });
+  return ret;
+}
+
+inline Future<void>
+Future<void>::WithTimeout(std::chrono::microseconds timeout) {
+  if (Ready())
+    return std::move(*this);
+
+  Promise<void> promise;
+  auto ret = promise.GetFuture();
+  auto hook = new __future_detail::TimeoutHook<void>(std::move(promise));
+  timer->Start(*hook, timeout, /* repeat = */ false);
+  Then([hook](Future<void> fut) { hook->Complete(std::move(fut)); });
+  return ret;
+}
+
 template <typename Res> bool Future<Res>::Valid() const {
-  return static_cast<bool>(state_);
+  return inline_ready_ || static_cast<bool>(state_);
 }
 
-inline bool Future<void>::Valid() const { return static_cast<bool>(state_); }
+inline bool Future<void>::Valid() const {
+  return inline_ready_ || static_cast<bool>(state_);
+}
 
 template <typename Res>
 Promise<Res>::Promise() : state_{std::make_shared<State>()} {}
@@ -815,32 +1265,53 @@ inline void Promise<void>::SetException(std::exception_ptr eptr) {
   state_->SetException(std::move(eptr));
 }
 
+template <typename Res>
+void Promise<Res>::SetCancellationToken(const CancellationToken& token) {
+  std::weak_ptr<State> weak = state_;
+  token.OnCancel([weak]() {
+    if (auto state = weak.lock())
+      state->Cancel();
+  });
+}
+
+inline void
+Promise<void>::SetCancellationToken(const CancellationToken& token) {
+  std::weak_ptr<State> weak = state_;
+  token.OnCancel([weak]() {
+    if (auto state = weak.lock())
+      state->Cancel();
+  });
+}
+
 template <typename Res> Future<Res> Promise<Res>::GetFuture() {
   return Future<Res>{state_};
 }
 
 inline Future<void> Promise<void>::GetFuture() { return Future<void>{state_}; }
 
-template <typename Res> __future_detail::State<Res>::State() : ready_{false} {}
+template <typename Res>
+__future_detail::State<Res>::State()
+    : status_{kPending}, claimed_{false} {}
 
-inline __future_detail::State<void>::State() : ready_{false} {}
+inline __future_detail::State<void>::State()
+    : status_{kPending}, claimed_{false} {}
 
 template <typename Res>
 template <typename... Args>
 __future_detail::State<Res>::State(__future_detail::MakeReadyFutureTag tag,
                                    Args&&... args)
-    : val_(std::forward<Args>(args)...), ready_{true} {}
+    : val_(std::forward<Args>(args)...), status_{kReady}, claimed_{true} {}
 
 inline __future_detail::State<void>::State(
     __future_detail::MakeReadyFutureTag tag)
-    : ready_{true} {}
+    : status_{kReady}, claimed_{true} {}
 
 template <typename Res>
 __future_detail::State<Res>::State(std::exception_ptr eptr)
-    : eptr_{std::move(eptr)}, ready_{true} {}
+    : eptr_{std::move(eptr)}, status_{kReady}, claimed_{true} {}
 
 inline __future_detail::State<void>::State(std::exception_ptr eptr)
-    : eptr_{std::move(eptr)}, ready_{true} {}
+    : eptr_{std::move(eptr)}, status_{kReady}, claimed_{true} {}
 
 template <typename Res>
 template <typename F, typename R>
@@ -855,36 +1326,13 @@ __future_detail::State<void>::Then(Launch policy, F&& func, R fut) {
   return ThenHelp(policy, std::forward<F>(func), std::move(fut));
 }
 
-// Non void return thenhelp
-template <typename Res>
+// Non void return thenready
 template <typename F, typename R>
 typename std::enable_if<
     !std::is_void<typename std::result_of<F(R)>::type>::value,
     Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
-__future_detail::State<Res>::ThenHelp(Launch policy, F&& func, R fut) {
+__future_detail::ThenReady(Launch policy, F&& func, R fut) {
   typedef typename std::result_of<F(R)>::type result_type;
-  if (!Ready()) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    // Have to check ready again to avoid a race
-    if (!Ready()) {
-      // helper sets function to be called
-      auto prom = Promise<result_type>();
-      auto ret = prom.GetFuture();
-      if (func_)
-        throw std::runtime_error("Multiple thens on a future!");
-      func_ = [
-        prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
-      ]() mutable {
-        try {
-          prom.SetValue(fn(std::move(fut)));
-        } catch (...) {
-          prom.SetException(std::current_exception());
-        }
-      };
-      return flatten(std::move(ret));
-    }
-  }
-  // We only get here if Ready is true
   if (policy == Launch::Sync) {
     try {
       return flatten(MakeReadyFuture<result_type>(func(std::move(fut))));
@@ -899,38 +1347,17 @@ __future_detail::State<Res>::ThenHelp(Launch policy, F&& func, R fut) {
   }
 }
 
-// Non void return thenhelp
+// void return thenready
 template <typename F, typename R>
 typename std::enable_if<
-    !std::is_void<typename std::result_of<F(R)>::type>::value,
+    std::is_void<typename std::result_of<F(R)>::type>::value,
     Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
-__future_detail::State<void>::ThenHelp(Launch policy, F&& func, R fut) {
+__future_detail::ThenReady(Launch policy, F&& func, R fut) {
   typedef typename std::result_of<F(R)>::type result_type;
-  if (!Ready()) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    // Have to check ready again to avoid a race
-    if (!Ready()) {
-      // helper sets function to be called
-      auto prom = Promise<result_type>();
-      auto ret = prom.GetFuture();
-      if (func_)
-        throw std::runtime_error("Multiple thens on a future!");
-      func_ = [
-        prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
-      ]() mutable {
-        try {
-          prom.SetValue(fn(std::move(fut)));
-        } catch (...) {
-          prom.SetException(std::current_exception());
-        }
-      };
-      return flatten(std::move(ret));
-    }
-  }
-  // We only get here if Ready is true
   if (policy == Launch::Sync) {
     try {
-      return flatten(MakeReadyFuture<result_type>(func(std::move(fut))));
+      func(std::move(fut));
+      return flatten(MakeReadyFuture<result_type>());
     } catch (...) {
       return flatten(MakeFailedFuture<result_type>(std::current_exception()));
     }
@@ -942,139 +1369,192 @@ __future_detail::State<void>::ThenHelp(Launch policy, F&& func, R fut) {
   }
 }
 
-// void return thenhelp
+// Non void return thenhelp
 template <typename Res>
 template <typename F, typename R>
 typename std::enable_if<
-    std::is_void<typename std::result_of<F(R)>::type>::value,
+    !std::is_void<typename std::result_of<F(R)>::type>::value,
     Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
 __future_detail::State<Res>::ThenHelp(Launch policy, F&& func, R fut) {
   typedef typename std::result_of<F(R)>::type result_type;
   if (!Ready()) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    // Have to check ready again to avoid a race
-    if (!Ready()) {
-      // helper sets function to be called
-      auto prom = Promise<result_type>();
-      auto ret = prom.GetFuture();
-      if (func_)
-        throw std::runtime_error("Multiple thens on a future!");
-      func_ = [
-        prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
-      ]() mutable {
-        try {
-          fn(std::move(fut));
-          prom.SetValue();
-        } catch (...) {
-          prom.SetException(std::current_exception());
-        }
-      };
-      return flatten(std::move(ret));
+    if (status_.load(std::memory_order_relaxed) == kContinuation)
+      throw std::runtime_error("Multiple thens on a future!");
+    // helper sets function to be called
+    auto prom = Promise<result_type>();
+    auto ret = prom.GetFuture();
+    func_ = [
+      prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
+    ]() mutable {
+      try {
+        prom.SetValue(fn(std::move(fut)));
+      } catch (...) {
+        prom.SetException(std::current_exception());
+      }
+    };
+    if (!SetContinuation()) {
+      // the promise was fulfilled while we installed the continuation
+      ebbrt::event_manager->Spawn(std::move(func_));
     }
+    return flatten(std::move(ret));
   }
   // We only get here if Ready is true
-  if (policy == Launch::Sync) {
-    try {
-      func(std::move(fut));
-      return flatten(MakeReadyFuture<result_type>());
-    } catch (...) {
-      return flatten(MakeFailedFuture<result_type>(std::current_exception()));
+  return ThenReady(policy, std::forward<F>(func), std::move(fut));
+}
+
+// Non void return thenhelp
+template <typename F, typename R>
+typename std::enable_if<
+    !std::is_void<typename std::result_of<F(R)>::type>::value,
+    Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
+__future_detail::State<void>::ThenHelp(Launch policy, F&& func, R fut) {
+  typedef typename std::result_of<F(R)>::type result_type;
+  if (!Ready()) {
+    if (status_.load(std::memory_order_relaxed) == kContinuation)
+      throw std::runtime_error("Multiple thens on a future!");
+    // helper sets function to be called
+    auto prom = Promise<result_type>();
+    auto ret = prom.GetFuture();
+    func_ = [
+      prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
+    ]() mutable {
+      try {
+        prom.SetValue(fn(std::move(fut)));
+      } catch (...) {
+        prom.SetException(std::current_exception());
+      }
+    };
+    if (!SetContinuation()) {
+      // the promise was fulfilled while we installed the continuation
+      ebbrt::event_manager->Spawn(std::move(func_));
     }
-  } else {
-    return Async(
-        [ fn = std::forward<F>(func), fut = std::move(fut) ]() mutable {
-          return fn(std::move(fut));
-        });
+    return flatten(std::move(ret));
   }
+  // We only get here if Ready is true
+  return ThenReady(policy, std::forward<F>(func), std::move(fut));
 }
 
 // void return thenhelp
+template <typename Res>
 template <typename F, typename R>
 typename std::enable_if<
     std::is_void<typename std::result_of<F(R)>::type>::value,
     Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
-__future_detail::State<void>::ThenHelp(Launch policy, F&& func, R fut) {
+__future_detail::State<Res>::ThenHelp(Launch policy, F&& func, R fut) {
   typedef typename std::result_of<F(R)>::type result_type;
   if (!Ready()) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    // Have to check ready again to avoid a race
-    if (!Ready()) {
-      // helper sets function to be called
-      auto prom = Promise<result_type>();
-      auto ret = prom.GetFuture();
-      if (func_)
-        throw std::runtime_error("Multiple thens on a future!");
-      func_ = [
-        prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
-      ]() mutable {
-        try {
-          fn(std::move(fut));
-          prom.SetValue();
-        } catch (...) {
-          prom.SetException(std::current_exception());
-        }
-      };
-      return flatten(std::move(ret));
+    if (status_.load(std::memory_order_relaxed) == kContinuation)
+      throw std::runtime_error("Multiple thens on a future!");
+    // helper sets function to be called
+    auto prom = Promise<result_type>();
+    auto ret = prom.GetFuture();
+    func_ = [
+      prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
+    ]() mutable {
+      try {
+        fn(std::move(fut));
+        prom.SetValue();
+      } catch (...) {
+        prom.SetException(std::current_exception());
+      }
+    };
+    if (!SetContinuation()) {
+      // the promise was fulfilled while we installed the continuation
+      ebbrt::event_manager->Spawn(std::move(func_));
     }
+    return flatten(std::move(ret));
   }
   // We only get here if Ready is true
-  if (policy == Launch::Sync) {
-    try {
-      func(std::move(fut));
-      return flatten(MakeReadyFuture<result_type>());
-    } catch (...) {
-      return flatten(MakeFailedFuture<result_type>(std::current_exception()));
+  return ThenReady(policy, std::forward<F>(func), std::move(fut));
+}
+
+// void return thenhelp
+template <typename F, typename R>
+typename std::enable_if<
+    std::is_void<typename std::result_of<F(R)>::type>::value,
+    Future<typename Flatten<typename std::result_of<F(R)>::type>::type>>::type
+__future_detail::State<void>::ThenHelp(Launch policy, F&& func, R fut) {
+  typedef typename std::result_of<F(R)>::type result_type;
+  if (!Ready()) {
+    if (status_.load(std::memory_order_relaxed) == kContinuation)
+      throw std::runtime_error("Multiple thens on a future!");
+    // helper sets function to be called
+    auto prom = Promise<result_type>();
+    auto ret = prom.GetFuture();
+    func_ = [
+      prom = std::move(prom), fut = std::move(fut), fn = std::forward<F>(func)
+    ]() mutable {
+      try {
+        fn(std::move(fut));
+        prom.SetValue();
+      } catch (...) {
+        prom.SetException(std::current_exception());
+      }
+    };
+    if (!SetContinuation()) {
+      // the promise was fulfilled while we installed the continuation
+      ebbrt::event_manager->Spawn(std::move(func_));
     }
-  } else {
-    return Async(
-        [ fn = std::forward<F>(func), fut = std::move(fut) ]() mutable {
-          return fn(std::move(fut));
-        });
+    return flatten(std::move(ret));
   }
+  // We only get here if Ready is true
+  return ThenReady(policy, std::forward<F>(func), std::move(fut));
 }
 
 template <typename Res>
 void __future_detail::State<Res>::SetValue(const Res& res) {
+  if (!Claim())
+    return;
   val_ = res;
-  ready_ = true;
-  if (func_) {
-    ebbrt::event_manager->Spawn(std::move(func_));
-  }
+  Fulfil();
 }
 
 template <typename Res> void __future_detail::State<Res>::SetValue(Res&& res) {
+  if (!Claim())
+    return;
   val_ = std::move(res);
-  ready_ = true;
-  if (func_) {
-    ebbrt::event_manager->Spawn(std::move(func_));
-  }
+  Fulfil();
 }
 
 inline void __future_detail::State<void>::SetValue() {
-  ready_ = true;
-  if (func_) {
-    ebbrt::event_manager->Spawn(std::move(func_));
-  }
+  if (!Claim())
+    return;
+  Fulfil();
 }
 
 template <typename Res>
 void __future_detail::State<Res>::SetException(std::exception_ptr eptr) {
-  std::lock_guard<std::mutex> lock{mutex_};
+  if (!Claim())
+    return;
   eptr_ = ExceptionPtrWrapper(std::move(eptr));
-  ready_ = true;
-  if (func_) {
-    ebbrt::event_manager->Spawn(std::move(func_));
-  }
+  Fulfil();
 }
 
 inline void
 __future_detail::State<void>::SetException(std::exception_ptr eptr) {
-  std::lock_guard<std::mutex> lock{mutex_};
+  if (!Claim())
+    return;
   eptr_ = ExceptionPtrWrapper(std::move(eptr));
-  ready_ = true;
-  if (func_) {
-    ebbrt::event_manager->Spawn(std::move(func_));
-  }
+  Fulfil();
+}
+
+template <typename Res> void __future_detail::State<Res>::Cancel() {
+  if (!Claim())
+    return;
+  eptr_ = ExceptionPtrWrapper(
+      std::make_exception_ptr(CancelledError("Promise cancelled")));
+  // the consumer asked for this, dropping the future is not an error
+  eptr_.observed_ = true;
+  Fulfil();
+}
+
+inline void __future_detail::State<void>::Cancel() {
+  if (!Claim())
+    return;
+  eptr_ = ExceptionPtrWrapper(
+      std::make_exception_ptr(CancelledError("Promise cancelled")));
+  eptr_.observed_ = true;
+  Fulfil();
 }
 
 template <typename Res> Res& __future_detail::State<Res>::Get() {
@@ -1083,6 +1563,7 @@ template <typename Res> Res& __future_detail::State<Res>::Get() {
   }
 
   if (eptr_.eptr_ != nullptr) {
+    eptr_.observed_ = true;
     std::rethrow_exception(eptr_.eptr_);
   }
 
@@ -1095,15 +1576,52 @@ inline void __future_detail::State<void>::Get() {
   }
 
   if (eptr_.eptr_ != nullptr) {
+    eptr_.observed_ = true;
     std::rethrow_exception(eptr_.eptr_);
   }
 }
 
 template <typename Res> bool __future_detail::State<Res>::Ready() const {
-  return ready_;
+  return status_.load(std::memory_order_acquire) == kReady;
+}
+
+inline bool __future_detail::State<void>::Ready() const {
+  return status_.load(std::memory_order_acquire) == kReady;
+}
+
+template <typename Res> bool __future_detail::State<Res>::Claim() {
+  return !claimed_.exchange(true, std::memory_order_relaxed);
+}
+
+inline bool __future_detail::State<void>::Claim() {
+  return !claimed_.exchange(true, std::memory_order_relaxed);
+}
+
+// Returns false if the state became ready first, in which case the caller
+// must run the continuation
+template <typename Res> bool __future_detail::State<Res>::SetContinuation() {
+  uint8_t expected = kPending;
+  return status_.compare_exchange_strong(expected, kContinuation,
+                                         std::memory_order_acq_rel);
+}
+
+inline bool __future_detail::State<void>::SetContinuation() {
+  uint8_t expected = kPending;
+  return status_.compare_exchange_strong(expected, kContinuation,
+                                         std::memory_order_acq_rel);
+}
+
+template <typename Res> void __future_detail::State<Res>::Fulfil() {
+  if (status_.exchange(kReady, std::memory_order_acq_rel) == kContinuation) {
+    ebbrt::event_manager->Spawn(std::move(func_));
+  }
 }
 
-inline bool __future_detail::State<void>::Ready() const { return ready_; }
+inline void __future_detail::State<void>::Fulfil() {
+  if (status_.exchange(kReady, std::memory_order_acq_rel) == kContinuation) {
+    ebbrt::event_manager->Spawn(std::move(func_));
+  }
+}
 }  // namespace ebbrt
 
 #endif  // COMMON_SRC_INCLUDE_EBBRT_FUTURE_H_
@@ -5,13 +5,25 @@
 #ifndef COMMON_SRC_INCLUDE_EBBRT_MOVELAMBDA_H_
 #define COMMON_SRC_INCLUDE_EBBRT_MOVELAMBDA_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <type_traits>
 
 namespace ebbrt {
+// Callables (including their vtable pointer) up to this size are stored
+// inside the MovableFunction rather than on the heap. The default makes a
+// MovableFunction exactly one cache line.
+const constexpr size_t kMovableFunctionInlineSize = 56;
+
 template <typename ReturnType, typename... ParamTypes>
 class MovableFunctionBase {
  public:
   virtual ReturnType CallFunc(ParamTypes... p) = 0;
+  // Move construct this function into dst, which must be suitably sized and
+  // aligned
+  virtual MovableFunctionBase* MoveTo(void* dst) = 0;
   virtual ~MovableFunctionBase() {}
 };
 
@@ -29,6 +41,10 @@ class MovableFunctionImp
   ReturnType CallFunc(ParamTypes... p) override {
     return f_(std::forward<ParamTypes>(p)...);
   }
+  MovableFunctionBase<ReturnType, ParamTypes...>*
+  MoveTo(void* dst) override {
+    return new (dst) MovableFunctionImp(std::move(f_));
+  }
 
  private:
   f_type f_;
@@ -48,62 +64,145 @@ class MovableFunctionImp<F, void, ParamTypes...>
   void CallFunc(ParamTypes... p) override {
     f_(std::forward<ParamTypes>(p)...);
   }
+  MovableFunctionBase<void, ParamTypes...>* MoveTo(void* dst) override {
+    return new (dst) MovableFunctionImp(std::move(f_));
+  }
 
  private:
   f_type f_;
 };
 
-template <typename FuncType> class MovableFunction {};
+// Owns a type erased callable, either in an inline buffer or on the heap
+template <size_t InlineSize, typename ReturnType, typename... ParamTypes>
+class MovableFunctionStorage {
+  typedef MovableFunctionBase<ReturnType, ParamTypes...> base_type;
+  typedef typename std::aligned_storage<InlineSize, alignof(void*)>::type
+      buffer_type;
 
-template <typename ReturnType, typename... ParamTypes>
-class MovableFunction<ReturnType(ParamTypes...)> {
+  template <typename Imp, typename F> struct FitsInline {
+    static const constexpr bool value =
+        sizeof(Imp) <= sizeof(buffer_type) &&
+        alignof(Imp) <= alignof(buffer_type) &&
+        std::is_nothrow_move_constructible<typename std::decay<F>::type>::value;
+  };
+
+ public:
+  MovableFunctionStorage() = default;
+  template <typename F> explicit MovableFunctionStorage(F&& f) {
+    typedef MovableFunctionImp<F, ReturnType, ParamTypes...> imp_type;
+    Construct<imp_type>(std::forward<F>(f),
+                        std::integral_constant<
+                            bool, FitsInline<imp_type, F>::value>());
+  }
+  MovableFunctionStorage(const MovableFunctionStorage&) = delete;
+  MovableFunctionStorage(MovableFunctionStorage&& other) noexcept {
+    MoveFrom(other);
+  }
+  ~MovableFunctionStorage() { Reset(); }
+
+  MovableFunctionStorage& operator=(const MovableFunctionStorage&) = delete;
+  MovableFunctionStorage& operator=(MovableFunctionStorage&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+
+  base_type* get() const { return ptr_; }
+
+  void Reset() {
+    if (ptr_ == nullptr)
+      return;
+    if (IsInline()) {
+      ptr_->~base_type();
+    } else {
+      delete ptr_;
+    }
+    ptr_ = nullptr;
+  }
+
+ private:
+  template <typename Imp, typename F>
+  void Construct(F&& f, std::true_type /* inline */) {
+    ptr_ = new (&buf_) Imp(std::forward<F>(f));
+  }
+  template <typename Imp, typename F>
+  void Construct(F&& f, std::false_type /* inline */) {
+    ptr_ = new Imp(std::forward<F>(f));
+  }
+
+  bool IsInline() const {
+    auto p = reinterpret_cast<uintptr_t>(ptr_);
+    auto b = reinterpret_cast<uintptr_t>(&buf_);
+    return p >= b && p < b + sizeof(buf_);
+  }
+
+  void MoveFrom(MovableFunctionStorage& other) {
+    if (other.ptr_ == nullptr)
+      return;
+    if (other.IsInline()) {
+      ptr_ = other.ptr_->MoveTo(&buf_);
+      other.Reset();
+    } else {
+      // heap allocated functions are simply handed over
+      ptr_ = other.ptr_;
+      other.ptr_ = nullptr;
+    }
+  }
+
+  buffer_type buf_;
+  base_type* ptr_ = nullptr;
+};
+
+template <typename FuncType, size_t InlineSize = kMovableFunctionInlineSize>
+class MovableFunction {};
+
+template <typename ReturnType, typename... ParamTypes, size_t InlineSize>
+class MovableFunction<ReturnType(ParamTypes...), InlineSize> {
  public:
   MovableFunction() = default;
-  template <typename F>
-  MovableFunction(F&& f)
-      : ptr_(new MovableFunctionImp<F, ReturnType, ParamTypes...>(
-            std::forward<F>(f))) {}
+  template <typename F> MovableFunction(F&& f) : storage_(std::forward<F>(f)) {}
   MovableFunction(const MovableFunction&) = delete;
   MovableFunction(MovableFunction&& other) = default;
 
   MovableFunction& operator=(const MovableFunction&) = delete;
   MovableFunction& operator=(MovableFunction&& other) = default;
   template <typename... Args> auto operator()(Args&&... args) -> ReturnType {
-    return ptr_->CallFunc(std::forward<Args>(args)...);
+    return storage_.get()->CallFunc(std::forward<Args>(args)...);
   }
-  explicit operator bool() const { return static_cast<bool>(ptr_); }
+  explicit operator bool() const { return storage_.get() != nullptr; }
 
  private:
-  std::unique_ptr<MovableFunctionBase<ReturnType, ParamTypes...>> ptr_;
+  MovableFunctionStorage<InlineSize, ReturnType, ParamTypes...> storage_;
 };
 
-template <typename... ParamTypes> class MovableFunction<void(ParamTypes...)> {
+template <typename... ParamTypes, size_t InlineSize>
+class MovableFunction<void(ParamTypes...), InlineSize> {
  public:
   MovableFunction() = default;
-  MovableFunction(std::nullptr_t) : ptr_() {}
+  MovableFunction(std::nullptr_t) : storage_() {}
   template <typename F>
   MovableFunction(
       F&& f,
       // This parameter ensures that this overload can't be used with a
       // MovableFunction (e.g. copy or move)
-      typename std::enable_if<
-          !std::is_same<typename std::remove_reference<F>::type,
-                        MovableFunction<void(ParamTypes...)>>::value>::type* =
-          0)
-      : ptr_(new MovableFunctionImp<F, void, ParamTypes...>(
-            std::forward<F>(f))) {}
+      typename std::enable_if<!std::is_same<
+          typename std::remove_reference<F>::type,
+          MovableFunction<void(ParamTypes...), InlineSize>>::value>::type* = 0)
+      : storage_(std::forward<F>(f)) {}
   MovableFunction(const MovableFunction&) = delete;
   MovableFunction(MovableFunction&& other) = default;
 
   MovableFunction& operator=(const MovableFunction&) = delete;
   MovableFunction& operator=(MovableFunction&& other) = default;
   template <typename... Args> void operator()(Args&&... args) {
-    ptr_->CallFunc(std::forward<Args>(args)...);
+    storage_.get()->CallFunc(std::forward<Args>(args)...);
   }
-  explicit operator bool() const { return static_cast<bool>(ptr_); }
+  explicit operator bool() const { return storage_.get() != nullptr; }
 
  private:
-  std::unique_ptr<MovableFunctionBase<void, ParamTypes...>> ptr_;
+  MovableFunctionStorage<InlineSize, void, ParamTypes...> storage_;
 };
 }  // namespace ebbrt
 
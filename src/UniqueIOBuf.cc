@@ -5,6 +5,49 @@
 #include "Compiler.h"
 #include "UniqueIOBuf.h"
 
+#ifdef __ebbrt__
+#include "native/MemMap.h"
+#include "native/PageAllocator.h"
+
+namespace {
+// Zeroed buffers that take up most of a page are served from the page
+// allocator's pool of pre-zeroed pages, which is cheaper than calloc
+// clearing them on the spot. size includes the MutUniqueIOBuf descriptor, so
+// only capacities of a little under 2KB up to a little under 4KB qualify.
+// The pool holds single pages, larger buffers are still cleared by calloc.
+bool UseZeroedPage(size_t size) {
+  return size > ebbrt::pmem::kPageSize / 2 && size <= ebbrt::pmem::kPageSize;
+}
+
+ebbrt::mem_map::Page* ZeroedPageOf(void* ptr) {
+  auto addr = reinterpret_cast<uintptr_t>(ptr);
+  if (addr % ebbrt::pmem::kPageSize != 0 || addr > 0xFFFF800000000000)
+    return nullptr;
+  auto page = ebbrt::mem_map::AddrToPage(addr);
+  if (page == nullptr || page->usage != ebbrt::mem_map::Page::Usage::kIOBuf)
+    return nullptr;
+  return page;
+}
+
+void* AllocZeroed(size_t size) {
+  if (!UseZeroedPage(size))
+    return std::calloc(1, size);
+
+  auto pfn = ebbrt::page_allocator->AllocZeroed();
+  if (pfn == ebbrt::Pfn::None())
+    return nullptr;
+  auto page = ebbrt::mem_map::PfnToPage(pfn);
+  kassert(page != nullptr);
+  page->usage = ebbrt::mem_map::Page::Usage::kIOBuf;
+  return reinterpret_cast<void*>(pfn.ToAddr());
+}
+}
+#else
+namespace {
+void* AllocZeroed(size_t size) { return std::calloc(1, size); }
+}
+#endif
+
 ebbrt::UniqueIOBufOwner::UniqueIOBufOwner(uint8_t* p, size_t capacity)
     : ptr_(p), capacity_(capacity) {}
 
@@ -13,6 +56,16 @@ const uint8_t* ebbrt::UniqueIOBufOwner::Buffer() const { return ptr_; }
 size_t ebbrt::UniqueIOBufOwner::Capacity() const { return capacity_; }
 
 void ebbrt::UniqueIOBufOwner::operator delete(void* ptr) {
+#ifdef __ebbrt__
+  auto page = ZeroedPageOf(ptr);
+  if (page != nullptr) {
+    // clear the mark first, so a later allocation of this page is never
+    // mistaken for one of ours
+    page->usage = mem_map::Page::Usage::kInUse;
+    page_allocator->Free(Pfn::Down(reinterpret_cast<uintptr_t>(ptr)));
+    return;
+  }
+#endif
   // ptr came from malloc or calloc, so just free it
   free(ptr);
 }
@@ -22,7 +75,7 @@ ebbrt::MakeUniqueIOBuf(size_t capacity, bool zero_memory) {
   auto size = sizeof(MutUniqueIOBuf) + capacity;
   void* b;
   if (zero_memory) {
-    b = std::calloc(1, size);
+    b = AllocZeroed(size);
   } else {
     b = std::malloc(size);
   }
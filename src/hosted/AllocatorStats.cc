@@ -0,0 +1,94 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "AllocatorStats.h"
+
+#include "../CapnpMessage.h"
+#include "AllocatorStatsMessage.capnp.h"  //NOLINT
+
+EBBRT_PUBLISH_TYPE(ebbrt, AllocatorStats);
+
+ebbrt::AllocatorStats::AllocatorStats()
+    : Messagable<AllocatorStats>(kAllocatorStatsId) {}
+
+ebbrt::Future<ebbrt::AllocatorStatsReport>
+ebbrt::AllocatorStats::Query(Messenger::NetworkId nid) {
+  Promise<AllocatorStatsReport> promise;
+  auto ret = promise.GetFuture();
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    id = id_++;
+    promise_map_.emplace(id, std::move(promise));
+  }
+
+  IOBufMessageBuilder message;
+  auto builder = message.initRoot<allocator_stats_message::Request>();
+  builder.setMessageId(id);
+  SendMessage(nid, AppendHeader(message));
+  return ret;
+}
+
+void ebbrt::AllocatorStats::ReceiveMessage(Messenger::NetworkId nid,
+                                           std::unique_ptr<IOBuf>&& buf) {
+  auto reader = IOBufMessageReader(std::move(buf));
+  auto reply = reader.getRoot<allocator_stats_message::Reply>();
+
+  AllocatorStatsReport report;
+  for (auto size_class : reply.getSizeClasses()) {
+    AllocatorStatsReport::SizeClass sc;
+    sc.size = size_class.getSize();
+    sc.pages_held = size_class.getPagesHeld();
+    sc.live_objects = size_class.getLiveObjects();
+    sc.fragmentation = size_class.getFragmentation();
+    for (auto cpu_stats : size_class.getPerCpu()) {
+      AllocatorStatsReport::SlabCpu cpu;
+      cpu.cpu = cpu_stats.getCpu();
+      cpu.allocs = cpu_stats.getAllocs();
+      cpu.frees = cpu_stats.getFrees();
+      cpu.remote_frees = cpu_stats.getRemoteFrees();
+      cpu.slab_grows = cpu_stats.getSlabGrows();
+      cpu.slab_shrinks = cpu_stats.getSlabShrinks();
+      cpu.depot_gets = cpu_stats.getDepotGets();
+      cpu.depot_puts = cpu_stats.getDepotPuts();
+      cpu.slabs_held = cpu_stats.getSlabsHeld();
+      cpu.objects_cached = cpu_stats.getObjectsCached();
+      sc.per_cpu.push_back(cpu);
+    }
+    report.size_classes.emplace_back(std::move(sc));
+  }
+
+  for (auto node_stats : reply.getNodes()) {
+    AllocatorStatsReport::Node node;
+    node.nid = node_stats.getNid();
+    node.allocs = node_stats.getAllocs();
+    node.frees = node_stats.getFrees();
+    node.free_pages = node_stats.getFreePages();
+    for (auto blocks : node_stats.getFreeBlocks()) {
+      node.free_blocks.push_back(blocks);
+    }
+    node.cached_pages = node_stats.getCachedPages();
+    node.zeroed_pages = node_stats.getZeroedPages();
+    report.nodes.emplace_back(std::move(node));
+  }
+
+  auto vmem = reply.getVmem();
+  report.vmem.regions = vmem.getRegions();
+  report.vmem.allocated_regions = vmem.getAllocatedRegions();
+  report.vmem.allocated_pages = vmem.getAllocatedPages();
+  report.vmem.free_pages = vmem.getFreePages();
+  report.vmem.largest_free_pages = vmem.getLargestFreePages();
+  report.vmem.faults = vmem.getFaults();
+
+  auto promise = [this, &reply]() {
+    std::lock_guard<std::mutex> lock(m_);
+    auto it = promise_map_.find(reply.getMessageId());
+    if (it == promise_map_.end())
+      throw std::runtime_error("AllocatorStats: reply to unknown request");
+    auto promise = std::move(it->second);
+    promise_map_.erase(it);
+    return promise;
+  }();
+  promise.SetValue(std::move(report));
+}
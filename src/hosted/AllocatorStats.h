@@ -0,0 +1,96 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef HOSTED_SRC_INCLUDE_EBBRT_ALLOCATORSTATS_H_
+#define HOSTED_SRC_INCLUDE_EBBRT_ALLOCATORSTATS_H_
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../CacheAligned.h"
+#include "../Future.h"
+#include "../Message.h"
+#include "../StaticSharedEbb.h"
+#include "EbbRef.h"
+#include "StaticIds.h"
+
+namespace ebbrt {
+// Allocator statistics of a native instance, as returned by
+// AllocatorStats::Query
+struct AllocatorStatsReport {
+  struct SlabCpu {
+    uint32_t cpu;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t remote_frees;
+    uint64_t slab_grows;
+    uint64_t slab_shrinks;
+    uint64_t depot_gets;
+    uint64_t depot_puts;
+    uint64_t slabs_held;
+    uint64_t objects_cached;
+  };
+
+  struct SizeClass {
+    uint64_t size;
+    uint64_t pages_held;
+    uint64_t live_objects;
+    // fraction of the held pages not occupied by live objects
+    double fragmentation;
+    std::vector<SlabCpu> per_cpu;
+  };
+
+  struct Node {
+    uint32_t nid;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t free_pages;
+    std::vector<uint64_t> free_blocks;
+    // free pages held in per core caches and the zeroed page pool, not
+    // counted in free_pages
+    uint64_t cached_pages;
+    uint64_t zeroed_pages;
+  };
+
+  struct VMem {
+    uint64_t regions;
+    uint64_t allocated_regions;
+    uint64_t allocated_pages;
+    uint64_t free_pages;
+    uint64_t largest_free_pages;
+    // faults dispatched to the handlers of allocated regions
+    uint64_t faults;
+  };
+
+  std::vector<SizeClass> size_classes;
+  std::vector<Node> nodes;
+  VMem vmem;
+};
+
+class AllocatorStats : public StaticSharedEbb<AllocatorStats>,
+                       public CacheAligned,
+                       public Messagable<AllocatorStats> {
+ public:
+  AllocatorStats();
+
+  static void ClassInit() {}
+
+  // Snapshot the allocator counters of the native instance at nid
+  Future<AllocatorStatsReport> Query(Messenger::NetworkId nid);
+
+  void ReceiveMessage(Messenger::NetworkId nid, std::unique_ptr<IOBuf>&& buf);
+
+ private:
+  std::mutex m_;
+  std::unordered_map<uint64_t, Promise<AllocatorStatsReport>> promise_map_;
+  uint64_t id_ = 0;
+};
+
+const constexpr auto allocator_stats =
+    EbbRef<AllocatorStats>(kAllocatorStatsId);
+}  // namespace ebbrt
+
+#endif  // HOSTED_SRC_INCLUDE_EBBRT_ALLOCATORSTATS_H_
@@ -3,36 +3,52 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 //
-#include "../Timer.h"
+#include "Timer.h"
 #include "Context.h"
 #include "EventManager.h"
 
 const constexpr ebbrt::EbbId ebbrt::Timer::static_id;
 
-ebbrt::Timer::Timer() {}
+// The handler of a stopped timer may already have been queued, so it checks
+// stopped before touching the hook, which may be gone by then
+struct ebbrt::Timer::Hook::Deadline {
+  Deadline(boost::asio::io_service& io_service,
+           std::chrono::microseconds timeout)
+      : timer(io_service, boost::posix_time::microseconds(timeout.count())) {}
 
-void ebbrt::Timer::SetTimer(std::chrono::microseconds from_now) {
-  EBBRT_UNIMPLEMENTED();
-}
+  boost::asio::deadline_timer timer;
+  bool stopped = false;
+};
 
-void ebbrt::Timer::StopTimer() { EBBRT_UNIMPLEMENTED(); }
+ebbrt::Timer::Timer() {}
 
 void ebbrt::Timer::Start(Hook& hook, std::chrono::microseconds timeout,
-                         bool repeat) {
-  auto t = std::make_shared<boost::asio::deadline_timer>(
-      active_context->io_service_,
-      boost::posix_time::microseconds(timeout.count()));
+                         bool repeat, std::chrono::microseconds slack) {
+  auto d = std::make_shared<Hook::Deadline>(active_context->io_service_,
+                                            timeout);
+  hook.deadline_ = d;
 
-  t->async_wait(EventManager::WrapHandler(
-      [&hook, t, repeat, timeout](const boost::system::error_code& e) {
+  d->timer.async_wait(EventManager::WrapHandler(
+      [&hook, d, repeat, timeout](const boost::system::error_code& e) {
+        if (d->stopped) {
+          return;
+        }
         if (e) {
           ebbrt::kabort("ASIO Error: %d\n", e.value());
         }
         if (repeat) {
           timer->Start(hook, timeout, repeat);
+        } else {
+          hook.deadline_.reset();
         }
         hook.Fire();
       }));
 }
 
-void ebbrt::Timer::Stop(Hook& hook) { EBBRT_UNIMPLEMENTED(); }
+void ebbrt::Timer::Stop(Hook& hook) {
+  if (!hook.deadline_)
+    return;
+  hook.deadline_->stopped = true;
+  hook.deadline_->timer.cancel();
+  hook.deadline_.reset();
+}
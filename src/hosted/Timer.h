@@ -0,0 +1,47 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef HOSTED_SRC_INCLUDE_EBBRT_TIMER_H_
+#define HOSTED_SRC_INCLUDE_EBBRT_TIMER_H_
+
+#include <chrono>
+#include <memory>
+
+#include "../MulticoreEbbStatic.h"
+
+namespace ebbrt {
+
+class Timer : public MulticoreEbbStatic<Timer> {
+ public:
+  static void ClassInit() {} // no class wide static initialization logic
+
+  class Hook {
+   public:
+    virtual ~Hook() {}
+    virtual void Fire() = 0;
+
+   private:
+    struct Deadline;
+    // asio timer the hook is armed on, if any
+    std::shared_ptr<Deadline> deadline_;
+
+    friend Timer;
+  };
+
+  static const constexpr EbbId static_id = kTimerId;
+
+  Timer();
+
+  // Hosted timers are asio deadline timers which have no notion of slack, the
+  // hook fires at the timeout and slack is accepted for compatibility with
+  // native code. A hook must be stopped from the context that started it.
+  void Start(Hook&, std::chrono::microseconds timeout, bool repeat,
+             std::chrono::microseconds slack = std::chrono::microseconds::zero());
+  void Stop(Hook&);
+};
+
+const constexpr auto timer = EbbRef<Timer>(Timer::static_id);
+}  // namespace ebbrt
+
+#endif  // HOSTED_SRC_INCLUDE_EBBRT_TIMER_H_
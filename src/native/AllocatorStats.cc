@@ -0,0 +1,102 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "AllocatorStats.h"
+
+#include "../CapnpMessage.h"
+#include "Cpu.h"
+#include "GeneralPurposeAllocator.h"
+#include "Numa.h"
+#include "PageAllocator.h"
+#include "VMemAllocator.h"
+
+#include "AllocatorStatsMessage.capnp.h"
+
+EBBRT_PUBLISH_TYPE(ebbrt, AllocatorStats);
+
+ebbrt::AllocatorStats::AllocatorStats()
+    : Messagable<AllocatorStats>(kAllocatorStatsId) {}
+
+void ebbrt::AllocatorStats::ReceiveMessage(Messenger::NetworkId nid,
+                                           std::unique_ptr<IOBuf>&& buf) {
+  auto reader = IOBufMessageReader(std::move(buf));
+  auto request = reader.getRoot<allocator_stats_message::Request>();
+
+  IOBufMessageBuilder message;
+  auto reply = message.initRoot<allocator_stats_message::Reply>();
+  reply.setMessageId(request.getMessageId());
+
+  auto ncpus = Cpu::Count();
+  auto nnodes = numa::nodes->size();
+  auto nclasses = GeneralPurposeAllocatorType::NumSizeClasses();
+  auto size_classes = reply.initSizeClasses(nclasses);
+  for (size_t i = 0; i < nclasses; ++i) {
+    auto& root = GeneralPurposeAllocatorType::SizeClassRoot(i);
+    auto size_class = size_classes[i];
+    size_class.setSize(root.size());
+
+    uint64_t slabs = 0;
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    auto per_cpu = size_class.initPerCpu(ncpus);
+    for (size_t cpu = 0; cpu < ncpus; ++cpu) {
+      auto stats = root.GetStats(cpu);
+      auto cpu_stats = per_cpu[cpu];
+      cpu_stats.setCpu(cpu);
+      cpu_stats.setAllocs(stats.allocs);
+      cpu_stats.setFrees(stats.frees);
+      cpu_stats.setRemoteFrees(stats.remote_frees);
+      cpu_stats.setSlabGrows(stats.slab_grows);
+      cpu_stats.setSlabShrinks(stats.slab_shrinks);
+      cpu_stats.setDepotGets(stats.depot_gets);
+      cpu_stats.setDepotPuts(stats.depot_puts);
+      cpu_stats.setSlabsHeld(stats.slabs_held);
+      cpu_stats.setObjectsCached(stats.objects_cached);
+      slabs += stats.slabs_held;
+      allocs += stats.allocs;
+      frees += stats.frees;
+    }
+    for (size_t node = 0; node < nnodes; ++node) {
+      slabs += root.GetNodeStats(Nid(node)).slabs_held;
+    }
+
+    // objects are often freed on a different core than they were allocated
+    // on, only the sum across cores is meaningful
+    auto live = allocs > frees ? allocs - frees : 0;
+    auto pages = slabs << root.order();
+    size_class.setPagesHeld(pages);
+    size_class.setLiveObjects(live);
+    auto capacity = slabs * root.NumObjectsPerSlab();
+    if (capacity > 0 && live < capacity) {
+      size_class.setFragmentation(1.0 - static_cast<double>(live) / capacity);
+    }
+  }
+
+  auto nodes = reply.initNodes(nnodes);
+  for (size_t node = 0; node < nnodes; ++node) {
+    auto stats = PageAllocator::GetStats(Nid(node));
+    auto node_stats = nodes[node];
+    node_stats.setNid(node);
+    node_stats.setAllocs(stats.allocs);
+    node_stats.setFrees(stats.frees);
+    node_stats.setFreePages(stats.free_pages);
+    node_stats.setCachedPages(stats.cached_pages);
+    node_stats.setZeroedPages(stats.zeroed_pages);
+    auto free_blocks = node_stats.initFreeBlocks(stats.free_blocks.size());
+    for (size_t order = 0; order < stats.free_blocks.size(); ++order) {
+      free_blocks.set(order, stats.free_blocks[order]);
+    }
+  }
+
+  auto vstats = vmem_allocator->GetStats();
+  auto vmem = reply.initVmem();
+  vmem.setRegions(vstats.regions);
+  vmem.setAllocatedRegions(vstats.allocated_regions);
+  vmem.setAllocatedPages(vstats.allocated_pages);
+  vmem.setFreePages(vstats.free_pages);
+  vmem.setLargestFreePages(vstats.largest_free_pages);
+  vmem.setFaults(vstats.faults);
+
+  SendMessage(nid, AppendHeader(message));
+}
@@ -0,0 +1,32 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BAREMETAL_SRC_INCLUDE_EBBRT_ALLOCATORSTATS_H_
+#define BAREMETAL_SRC_INCLUDE_EBBRT_ALLOCATORSTATS_H_
+
+#include "../CacheAligned.h"
+#include "../Message.h"
+#include "../StaticSharedEbb.h"
+#include "EbbRef.h"
+#include "StaticIds.h"
+
+namespace ebbrt {
+// Answers allocator statistics requests from the hosted frontend. The
+// counters themselves are kept by the allocators, a request snapshots them
+// without stopping the other cores so the values may be slightly stale.
+class AllocatorStats : public StaticSharedEbb<AllocatorStats>,
+                       public CacheAligned,
+                       public Messagable<AllocatorStats> {
+ public:
+  AllocatorStats();
+
+  static void ClassInit() {}
+
+  void ReceiveMessage(Messenger::NetworkId nid, std::unique_ptr<IOBuf>&& buf);
+};
+
+constexpr auto allocator_stats = EbbRef<AllocatorStats>(kAllocatorStatsId);
+}  // namespace ebbrt
+
+#endif  // BAREMETAL_SRC_INCLUDE_EBBRT_ALLOCATORSTATS_H_
@@ -45,6 +45,12 @@ void ebbrt::apic::Ipi(uint8_t apic_id, uint8_t vector, bool level,
   msr::Write(msr::kX2apicIcr, val);
 }
 
+void ebbrt::apic::IpiAllButSelf(uint8_t vector) {
+  // destination shorthand 11b, the destination field is ignored
+  auto val = (uint64_t(3) << 18) | (uint64_t(1) << 14) | vector;
+  msr::Write(msr::kX2apicIcr, val);
+}
+
 uint32_t ebbrt::apic::GetId() { return msr::Read(msr::kX2apicIdr); }
 
 void ebbrt::apic::Eoi() {
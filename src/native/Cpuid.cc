@@ -27,9 +27,11 @@ struct CpuidBit {
 
 CpuidBit cpuid_bits[] = {
     {1, 2, 21, &ebbrt::cpuid::Features::x2apic},
+    {1, 2, 24, &ebbrt::cpuid::Features::tsc_deadline},
     {0x40000001, 0, 6, &ebbrt::cpuid::Features::kvm_pv_eoi, &kvm_vendor_id},
     {0x40000001, 0, 3, &ebbrt::cpuid::Features::kvm_clocksource2,
-     &kvm_vendor_id}};
+     &kvm_vendor_id},
+    {0x80000001, 3, 26, &ebbrt::cpuid::Features::pdpe1gb}};
 
 constexpr size_t nr_cpuid_bits = sizeof(cpuid_bits) / sizeof(CpuidBit);
 }  // namespace
@@ -18,8 +18,10 @@ struct Result {
 
 struct Features {
   bool x2apic;
+  bool tsc_deadline;
   bool kvm_pv_eoi;
   bool kvm_clocksource2;
+  bool pdpe1gb;
 };
 
 extern Features features;
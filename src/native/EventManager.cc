@@ -8,6 +8,7 @@
 
 #include <boost/container/flat_map.hpp>
 
+#include "../Clock.h"
 #include "../Compiler.h"
 #include "Cpu.h"
 #include "LocalIdMap.h"
@@ -32,11 +33,143 @@ struct vec_data_t : public ebbrt::CacheAligned {
 };
 
 ebbrt::ExplicitlyConstructed<vec_data_t> vec_data;
+
+std::atomic<bool> work_stealing{false};
+// Every time this many more tasks are waiting in a stealable queue, an idle
+// core is woken up to help. A handful of short tasks are drained quicker by
+// their own core than by waking another one
+const constexpr size_t kStealKickThreshold = 8;
+// A core is not woken to steal again this soon after its last wakeup, so a
+// core that lost the race for the backlog is not repeatedly interrupted
+const constexpr std::chrono::nanoseconds kStealKickInterval =
+    std::chrono::microseconds(50);
+
+// RCU grace periods are tracked with a combining tree. Each core reports a
+// quiescent state by clearing its bit in a leaf, the last core to clear a
+// node's mask carries the report up to the parent, and whoever clears the
+// root completes the grace period. Latency grows with the depth of the tree
+// rather than with the number of cores.
+const constexpr size_t kRcuFanout = 8;
+const constexpr size_t kMaxRcuNodes = 64;
+static_assert(ebbrt::Cpu::kMaxCpus / kRcuFanout +
+                      ebbrt::Cpu::kMaxCpus / (kRcuFanout * kRcuFanout) + 2 <=
+                  kMaxRcuNodes,
+              "adjust kMaxRcuNodes");
+
+struct RcuNode : ebbrt::CacheAligned {
+  ebbrt::SpinLock lock;
+  // children yet to report a quiescent state for the current grace period
+  uint64_t qs_mask{0};
+  // all children
+  uint64_t init_mask{0};
+  RcuNode* parent{nullptr};
+  // our bit in the parent's mask
+  uint64_t parent_bit{0};
+};
+
+struct RcuState {
+  // serializes starting and completing grace periods
+  ebbrt::SpinLock gp_lock;
+  std::atomic<uint64_t> gp_started{0};
+  std::atomic<uint64_t> gp_completed{0};
+  // Callbacks queued across all cores that are still waiting for a grace
+  // period, indexed by that grace period. Only the two grace periods after the
+  // last completed one can have waiters. A slot is cleared when its grace
+  // period completes (the callbacks may run later), and grace periods are only
+  // run while the next one has waiters so idle cores are left alone.
+  std::array<std::atomic<size_t>, 4> callbacks_waiting{};
+  bool enabled{false};
+  boost::container::static_vector<RcuNode, kMaxRcuNodes> nodes;
+  std::array<RcuNode*, ebbrt::Cpu::kMaxCpus> leaves;
+};
+
+ebbrt::ExplicitlyConstructed<RcuState> rcu_state;
+
+std::atomic<size_t>& CallbacksWaiting(uint64_t gp) {
+  return rcu_state->callbacks_waiting[gp % rcu_state->callbacks_waiting.size()];
+}
+
+// How long a grace period may be held back to batch callbacks, and the most
+// callbacks run per pass of the event loop
+const constexpr std::chrono::microseconds kRcuGpDelay =
+    std::chrono::microseconds(1000);
+const constexpr size_t kRcuBatchLimit = 64;
+
+// Visit every other core, those on the same NUMA node as the calling core
+// first, until f returns true
+template <typename F> bool VisitPeers(F&& f) {
+  size_t mine = ebbrt::Cpu::GetMine();
+  auto my_nid = ebbrt::Cpu::GetMyNode();
+  auto count = ebbrt::Cpu::Count();
+  for (auto same_node : {true, false}) {
+    for (size_t i = 1; i < count; ++i) {
+      auto idx = (mine + i) % count;
+      auto cpu = ebbrt::Cpu::GetByIndex(idx);
+      kassert(cpu != nullptr);
+      if ((cpu->nid() == my_nid) != same_node)
+        continue;
+      if (f(idx))
+        return true;
+    }
+  }
+  return false;
+}
+
+// Under memory pressure, idle event stacks give back their backing pages
+struct StackShrinker : ebbrt::PageAllocator::Shrinker {
+  void Shrink(ebbrt::Nid nid) override {
+    if (ebbrt::Cpu::GetMyNode() == nid)
+      ebbrt::event_manager->ReleaseFreeStacks();
+  }
+};
+
+ebbrt::ExplicitlyConstructed<StackShrinker> stack_shrinker;
 }  // namespace
 
 void ebbrt::EventManager::Init() {
   vec_data.construct();
   local_id_map->Insert(std::make_pair(kEventManagerId, RepMap()));
+
+  // Build the grace period tree bottom up, cores are grouped into leaves by
+  // index
+  rcu_state.construct();
+  auto& nodes = rcu_state->nodes;
+  auto ncpus = Cpu::Count();
+  size_t width = (ncpus + kRcuFanout - 1) / kRcuFanout;
+  for (size_t i = 0; i < width; ++i) {
+    nodes.emplace_back();
+  }
+  for (size_t i = 0; i < ncpus; ++i) {
+    auto& leaf = nodes[i / kRcuFanout];
+    leaf.init_mask |= uint64_t(1) << (i % kRcuFanout);
+    rcu_state->leaves[i] = &leaf;
+  }
+  size_t level_start = 0;
+  while (width > 1) {
+    auto parent_start = nodes.size();
+    auto parent_width = (width + kRcuFanout - 1) / kRcuFanout;
+    for (size_t i = 0; i < parent_width; ++i) {
+      nodes.emplace_back();
+    }
+    for (size_t i = 0; i < width; ++i) {
+      auto& child = nodes[level_start + i];
+      auto& parent = nodes[parent_start + i / kRcuFanout];
+      child.parent = &parent;
+      child.parent_bit = uint64_t(1) << (i % kRcuFanout);
+      parent.init_mask |= child.parent_bit;
+    }
+    level_start = parent_start;
+    width = parent_width;
+  }
+
+  stack_shrinker.construct();
+  PageAllocator::RegisterShrinker(*stack_shrinker);
+}
+
+// Cores walk each other's reps while stealing, so this should only be enabled
+// once every core has brought up its EventManager
+void ebbrt::EventManager::EnableWorkStealing(bool enable) {
+  work_stealing.store(enable, std::memory_order_relaxed);
 }
 
 ebbrt::EventManager& ebbrt::EventManager::HandleFault(EbbId id) {
@@ -96,6 +229,17 @@ class EventStackFaultHandler : public ebbrt::VMemAllocator::PageFaultHandler {
     }
   }
 
+  // Unmap and free the backing pages, the stack must not be in use. Stacks
+  // are only used by the core that allocated them, so only its TLB needs
+  // flushing.
+  void Release() {
+    for (auto& mapping : mappings_) {
+      ebbrt::vmem::UnmapMemory(mapping.first);
+      ebbrt::page_allocator->Free(mapping.second);
+    }
+    mappings_.clear();
+  }
+
  private:
   std::unordered_map<ebbrt::Pfn, ebbrt::Pfn> mappings_;
 };
@@ -120,6 +264,8 @@ template <typename F> void ebbrt::EventManager::InvokeFunction(F&& f) {
     ++generation_count_[generation % 2];
     f();
     --generation_count_[generation % 2];
+    if (unlikely(rcu_qs_pending_))
+      CheckGeneration();
   } catch (std::exception& e) {
     ebbrt::kabort("Unhandled exception caught: %s\n", e.what());
   } catch (...) {
@@ -141,6 +287,16 @@ process:
   // If an interrupt was processed then we would not reach this code (the
   // interrupt does not return here but instead to the top of this function)
 
+  // We are between events, report a quiescent state owed for a grace period
+  // noticed since the last event ended
+  if (unlikely(RcuQsReady()))
+    CheckGeneration();
+
+  // Run a bounded batch of RCU callbacks and fall through, so a long list of
+  // callbacks cannot starve other events
+  if (RcuCallbacksReady())
+    InvokeFunction([this]() { InvokeRcuCallbacks(); });
+
   if (!tasks_.empty()) {
     auto f = std::move(tasks_.front());
     tasks_.pop_front();
@@ -149,11 +305,54 @@ process:
     goto process;
   }
 
-  if (idle_callback_) {
-    InvokeFunction(*idle_callback_);
+  if (remote_batch_head_ != nullptr) {
+    auto task = remote_batch_head_;
+    remote_batch_head_ = task->next;
+    if (remote_batch_head_ == nullptr)
+      remote_batch_tail_ = &remote_batch_head_;
+    auto f = std::move(task->func);
+    FreeRemoteTask(task);
+    InvokeFunction(f);
+    goto process;
+  }
+
+  // tasks on our stealable queue may still be around if stealing was disabled
+  // after they were spawned, so always check it
+  if (stealable_.size.load(std::memory_order_relaxed) != 0) {
+    std::unique_lock<ebbrt::SpinLock> l(stealable_.lock);
+    if (!stealable_.tasks.empty()) {
+      auto f = std::move(stealable_.tasks.front());
+      stealable_.tasks.pop_front();
+      stealable_.size.fetch_sub(1, std::memory_order_relaxed);
+      l.unlock();
+      InvokeFunction(f);
+      goto process;
+    }
+  }
+
+  if (RcuCallbacksReady() || RcuQsReady())
+    goto process;
+
+  if (work_stealing.load(std::memory_order_relaxed) && TrySteal())
+    goto process;
+
+  if (!idle_callbacks_.empty()) {
+    // rotate before invoking so the callbacks take turns and the one invoked
+    // can stop itself
+    auto& callback = idle_callbacks_.front();
+    idle_callbacks_.pop_front();
+    idle_callbacks_.push_back(callback);
+    InvokeFunction(callback.f_);
     goto process;
   }
 
+  // Advertise that we are about to halt so that a core with a backlog can
+  // wake us. The sti below keeps interrupts masked until the hlt, so a wakeup
+  // IPI sent after this store cannot be lost.
+  if (work_stealing.load(std::memory_order_relaxed))
+    idle_.store(true, std::memory_order_release);
+  halted_ = true;
+
   asm volatile("sti;"
                "hlt;");
   kabort("Woke up from halt?!?!");
@@ -166,12 +365,27 @@ ebbrt::Pfn ebbrt::EventManager::AllocateStack() {
     return ret;
   }
   auto fault_handler = new EventStackFaultHandler;
-  return vmem_allocator->Alloc(
+  auto stack = vmem_allocator->Alloc(
       kStackPages, std::unique_ptr<EventStackFaultHandler>(fault_handler));
+  stack_handlers_[stack] = fault_handler;
+  return stack;
 }
 
 void ebbrt::EventManager::FreeStack(Pfn stack) { free_stacks_.push(stack); }
 
+void ebbrt::EventManager::ReleaseFreeStacks() {
+  std::stack<Pfn> stacks;
+  while (!free_stacks_.empty()) {
+    auto stack = free_stacks_.top();
+    free_stacks_.pop();
+    auto it = stack_handlers_.find(stack);
+    kassert(it != stack_handlers_.end());
+    it->second->Release();
+    stacks.push(stack);
+  }
+  free_stacks_.swap(stacks);
+}
+
 static_assert(ebbrt::Cpu::kMaxCpus <= 256, "adjust event id calculation");
 
 ebbrt::EventManager::EventManager(const RepMap& rm)
@@ -180,9 +394,87 @@ ebbrt::EventManager::EventManager(const RepMap& rm)
 
 void ebbrt::EventManager::Spawn(MovableFunction<void()> func,
                                 bool force_async) {
+  if (unlikely(force_async) && work_stealing.load(std::memory_order_relaxed)) {
+    AddStealableTask(std::move(func));
+    return;
+  }
   SpawnLocal(std::move(func), force_async);
 }
 
+void ebbrt::EventManager::AddStealableTask(MovableFunction<void()> func) {
+  size_t size;
+  {
+    std::lock_guard<ebbrt::SpinLock> lock(stealable_.lock);
+    stealable_.tasks.emplace_back(std::move(func));
+    size = stealable_.size.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  if (size % kStealKickThreshold == 0)
+    KickIdleCore();
+}
+
+// Wake one halted core, preferring our own NUMA node, so it can steal from
+// our backlog
+void ebbrt::EventManager::KickIdleCore() {
+  auto now = clock::Wall::Now().time_since_epoch().count();
+  VisitPeers([this, now](size_t idx) {
+    auto it = reps_.find(idx);
+    if (it == reps_.end())
+      return false;
+    auto& target = *it->second;
+    if (!target.idle_.load(std::memory_order_relaxed) ||
+        now - target.last_kick_.load(std::memory_order_relaxed) <
+            kStealKickInterval.count() ||
+        !target.idle_.exchange(false, std::memory_order_acquire))
+      return false;
+    target.last_kick_.store(now, std::memory_order_relaxed);
+    apic::Ipi(Cpu::GetByIndex(idx)->apic_id(), 32);
+    return true;
+  });
+}
+
+bool ebbrt::EventManager::TrySteal() {
+  return VisitPeers([this](size_t idx) {
+    auto it = reps_.find(idx);
+    if (it == reps_.end())
+      return false;
+    return StealFrom(*it->second);
+  });
+}
+
+// Move the older half of the victim's stealable tasks onto our local queue
+bool ebbrt::EventManager::StealFrom(EventManager& victim) {
+  if (victim.stealable_.size.load(std::memory_order_relaxed) == 0)
+    return false;
+
+  std::lock_guard<ebbrt::SpinLock> lock(victim.stealable_.lock);
+  auto size = victim.stealable_.tasks.size();
+  if (size == 0)
+    return false;
+  auto n = (size + 1) / 2;
+  auto end = victim.stealable_.tasks.begin();
+  std::advance(end, n);
+  tasks_.splice(tasks_.end(), victim.stealable_.tasks,
+                victim.stealable_.tasks.begin(), end);
+  victim.stealable_.size.fetch_sub(n, std::memory_order_relaxed);
+  victim.stealable_.migrations += n;
+  steals_ += n;
+  return true;
+}
+
+uint64_t ebbrt::EventManager::GetWakeupCount(size_t cpu) const {
+  auto it = reps_.find(cpu);
+  kassert(it != reps_.end());
+  return it->second->wakeups_;
+}
+
+ebbrt::EventManager::StealStats
+ebbrt::EventManager::GetStealStats(size_t cpu) const {
+  auto it = reps_.find(cpu);
+  kassert(it != reps_.end());
+  auto& rep = *it->second;
+  return StealStats{rep.steals_, rep.stealable_.migrations};
+}
+
 extern "C" void
 ActivateContextAndReturn(const ebbrt::EventManager::EventContext& context)
     __attribute__((noreturn));
@@ -237,19 +529,68 @@ void ebbrt::EventManager::SpawnLocal(MovableFunction<void()> func,
   }
 }
 
-void ebbrt::EventManager::AddRemoteTask(MovableFunction<void()> func) {
-  std::lock_guard<ebbrt::SpinLock> lock(remote_.lock);
-  remote_.tasks.emplace_back(std::move(func));
+ebbrt::EventManager::RemoteTask* ebbrt::EventManager::AllocateRemoteTask() {
+  if (remote_free_local_ == nullptr) {
+    // take back everything other cores have finished with in one go, only we
+    // ever pop so there is no ABA problem
+    remote_free_local_ =
+        remote_free_.head.exchange(nullptr, std::memory_order_acquire);
+    if (remote_free_local_ == nullptr)
+      return new RemoteTask(this);
+  }
+  auto task = remote_free_local_;
+  remote_free_local_ = task->next;
+  return task;
+}
+
+// Called on the core that ran the task, returns it to the core that spawned
+// it
+void ebbrt::EventManager::FreeRemoteTask(RemoteTask* task) {
+  auto& head = task->origin->remote_free_.head;
+  task->next = head.load(std::memory_order_relaxed);
+  while (!head.compare_exchange_weak(task->next, task,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+// Returns true if the queue was empty, in which case the caller must send an
+// IPI for the task to be noticed. Any task pushed onto a non empty queue will
+// be picked up by the drain triggered by the first one.
+bool ebbrt::EventManager::AddRemoteTask(RemoteTask* task) {
+  task->next = remote_.head.load(std::memory_order_relaxed);
+  while (!remote_.head.compare_exchange_weak(task->next, task,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+  }
+  return task->next == nullptr;
+}
+
+void ebbrt::EventManager::DrainRemoteTasks() {
+  auto newest = remote_.head.exchange(nullptr, std::memory_order_acquire);
+  if (newest == nullptr)
+    return;
+  // tasks were pushed onto the head, so reverse them to preserve spawn order
+  RemoteTask* oldest = nullptr;
+  auto task = newest;
+  while (task != nullptr) {
+    auto next = task->next;
+    task->next = oldest;
+    oldest = task;
+    task = next;
+  }
+  *remote_batch_tail_ = oldest;
+  remote_batch_tail_ = &newest->next;
 }
 
 void ebbrt::EventManager::SpawnRemote(MovableFunction<void()> func,
                                       size_t cpu) {
   auto rep = reps_.find(cpu);
   kassert(rep != reps_.end());
-  rep->second->AddRemoteTask(std::move(func));
-  // We might want to do a queue of ipi's that can
-  // be cancelled if the work was acked via shared memory due to
-  // natural polling on the remote processor
+  auto task = AllocateRemoteTask();
+  task->func = std::move(func);
+  if (!rep->second->AddRemoteTask(task))
+    return;
   auto c = Cpu::GetByIndex(cpu);
   kassert(c != nullptr);
   auto apic_id = c->apic_id();
@@ -328,12 +669,16 @@ uint8_t ebbrt::EventManager::AllocateVector(MovableFunction<void()> func) {
 
 void ebbrt::EventManager::ProcessInterrupt(int num) {
   apic::Eoi();
+  idle_.store(false, std::memory_order_relaxed);
+  if (halted_) {
+    halted_ = false;
+    ++wakeups_;
+  }
   if (num == 32) {
     // pull all remote tasks onto our queue
-    std::lock_guard<ebbrt::SpinLock> l(remote_.lock);
-    tasks_.splice(tasks_.end(), std::move(remote_.tasks));
+    DrainRemoteTasks();
   } else if (num == 33) {
-    ReceiveToken();
+    NoteGracePeriod();
   } else {
     auto ih = vec_data->map.find(num);
     kassert(ih != nullptr);
@@ -357,16 +702,15 @@ std::unordered_map<__gthread_key_t, void*>& ebbrt::EventManager::GetTlsMap() {
 
 void ebbrt::EventManager::IdleCallback::Start() {
   if (!started_) {
-    kbugon(event_manager->idle_callback_ != nullptr,
-           "Multiple idle callbacks!\n");
-    event_manager->idle_callback_ = &f_;
+    event_manager->idle_callbacks_.push_back(*this);
     started_ = true;
   }
 }
 
 void ebbrt::EventManager::IdleCallback::Stop() {
   if (started_) {
-    event_manager->idle_callback_ = nullptr;
+    auto& callbacks = event_manager->idle_callbacks_;
+    callbacks.erase(callbacks.iterator_to(*this));
     started_ = false;
   }
 }
@@ -376,49 +720,136 @@ ebbrt::EventManager::EventContext::EventContext() : cpu(Cpu::GetMine()) {}
 ebbrt::EventManager::EventContext::EventContext(uint32_t event_id, Pfn stack)
     : event_id(event_id), stack(stack), cpu(Cpu::GetMine()) {}
 
-void ebbrt::EventManager::PassToken() {
-  size_t my_cpu_index = Cpu::GetMine();
-  if (Cpu::Count() > 1) {
-    auto next_cpu_index = (my_cpu_index + 1) % Cpu::Count();
-    auto next_cpu = Cpu::GetByIndex(next_cpu_index);
-    kassert(next_cpu != nullptr);
-    apic::Ipi(next_cpu->apic_id(), 33);
-  } else {
-    ReceiveToken();
+// Called once all cores are up, grace periods started before then would wait
+// on cores that cannot yet receive IPIs
+void ebbrt::EventManager::StartRcu() {
+  {
+    std::lock_guard<ebbrt::SpinLock> lock(rcu_state->gp_lock);
+    rcu_state->enabled = true;
+  }
+  StartGracePeriod();
+}
+
+void ebbrt::EventManager::StartGracePeriod() {
+  {
+    std::lock_guard<ebbrt::SpinLock> lock(rcu_state->gp_lock);
+    auto started = rcu_state->gp_started.load();
+    if (!rcu_state->enabled || started != rcu_state->gp_completed.load() ||
+        CallbacksWaiting(started + 1).load() == 0)
+      return;
+    // No core reports for a grace period until it sees it started, so the
+    // masks may be reset without taking the node locks
+    for (auto& node : rcu_state->nodes) {
+      node.qs_mask = node.init_mask;
+    }
+    rcu_state->gp_started.store(started + 1);
+  }
+  if (Cpu::Count() > 1)
+    apic::IpiAllButSelf(33);
+  // This core reports from its event loop, not from here: we may be completing
+  // the previous grace period on behalf of this core, and reporting again
+  // could complete this one and start the next recursively
+  event_manager->NoteGracePeriod();
+}
+
+void ebbrt::EventManager::CompleteGracePeriod() {
+  {
+    std::lock_guard<ebbrt::SpinLock> lock(rcu_state->gp_lock);
+    auto gp = rcu_state->gp_started.load();
+    // The callbacks of this grace period no longer wait, they run as each
+    // core gets to them
+    CallbacksWaiting(gp).store(0);
+    rcu_state->gp_completed.store(gp);
   }
+  // Callbacks queued during the grace period form the next batch. Cores with
+  // callbacks left are notified of completion by the start of the next grace
+  // period.
+  StartGracePeriod();
+}
+
+void ebbrt::EventManager::ExpediteRcu() { StartGracePeriod(); }
+
+void ebbrt::EventManager::RcuGpTimer::Fire() {
+  armed = false;
+  StartGracePeriod();
 }
 
-void ebbrt::EventManager::ReceiveToken() {
+// Begin waiting for a quiescent state if a new grace period has started
+void ebbrt::EventManager::NoteGracePeriod() {
+  auto gp = rcu_state->gp_started.load();
+  if (gp == rcu_gp_seen_ || gp == rcu_state->gp_completed.load())
+    return;
+  rcu_gp_seen_ = gp;
+  rcu_qs_pending_ = true;
+  // Events started from here on are in a new generation, once the previous
+  // generation drains this core has passed through a quiescent state. That is
+  // checked at the end of an event or from the event loop.
   pending_generation_ = generation_++;
+}
+
+bool ebbrt::EventManager::RcuQsReady() {
+  return rcu_qs_pending_ && generation_count_[pending_generation_ % 2] == 0;
+}
+
+void ebbrt::EventManager::CheckGeneration() {
+  if (generation_count_[pending_generation_ % 2] != 0)
+    return;
+  rcu_qs_pending_ = false;
+  ReportQuiescentState();
+}
 
-  StartTimer();
-}
-
-// Check Generation
-void ebbrt::EventManager::Fire() {
-  if (generation_count_[pending_generation_ % 2] == 0) {
-    // generation complete
-    PassToken();
-    // temporarily store tasks that have now lived at least one entire
-    // generation (can be invoked)
-    auto tasks = std::move(prev_rcu_tasks_);
-    // current tasks stored
-    prev_rcu_tasks_ = std::move(curr_rcu_tasks_);
-    while (!tasks.empty()) {
-      auto& task = tasks.front();
-      SpawnLocal(std::move(task));
-      tasks.pop();
+void ebbrt::EventManager::ReportQuiescentState() {
+  size_t mine = Cpu::GetMine();
+  auto node = rcu_state->leaves[mine];
+  auto bit = uint64_t(1) << (mine % kRcuFanout);
+  while (true) {
+    {
+      std::lock_guard<ebbrt::SpinLock> lock(node->lock);
+      node->qs_mask &= ~bit;
+      if (node->qs_mask != 0)
+        return;
     }
-  } else {
-    StartTimer();
+    // we cleared the last bit of this node, propagate upwards
+    if (node->parent == nullptr)
+      break;
+    bit = node->parent_bit;
+    node = node->parent;
   }
+  CompleteGracePeriod();
+}
+
+bool ebbrt::EventManager::RcuCallbacksReady() {
+  return !rcu_callbacks_.empty() &&
+         rcu_callbacks_.front().gp <=
+             rcu_state->gp_completed.load(std::memory_order_acquire);
 }
 
-void ebbrt::EventManager::StartTimer() {
-  timer->Start(*this, std::chrono::milliseconds(1),
-               /* repeat = */ false);
+// Invoke up to kRcuBatchLimit callbacks whose grace period has completed
+void ebbrt::EventManager::InvokeRcuCallbacks() {
+  auto completed = rcu_state->gp_completed.load(std::memory_order_acquire);
+  size_t n = 0;
+  while (n < kRcuBatchLimit && !rcu_callbacks_.empty() &&
+         rcu_callbacks_.front().gp <= completed) {
+    auto f = std::move(rcu_callbacks_.front().func);
+    rcu_callbacks_.pop();
+    ++n;
+    f();
+  }
 }
 
 void ebbrt::EventManager::DoRcu(MovableFunction<void()> func) {
-  curr_rcu_tasks_.emplace(std::move(func));
+  // If a grace period is in progress it may have started before the caller's
+  // update, so wait for the one after it. That grace period cannot complete
+  // before the count is raised, as this core is inside an event.
+  auto started = rcu_state->gp_started.load();
+  CallbacksWaiting(started + 1).fetch_add(1);
+  rcu_callbacks_.emplace(RcuCallback{started + 1, std::move(func)});
+  if (started != rcu_state->gp_completed.load() || rcu_gp_timer_.armed ||
+      !rcu_state->enabled)
+    return;
+  // No grace period is running, start one shortly so that a burst of
+  // callbacks is batched into it
+  rcu_gp_timer_.armed = true;
+  timer->Start(rcu_gp_timer_, kRcuGpDelay, /* repeat = */ false,
+               /* slack = */ kRcuGpDelay);
 }
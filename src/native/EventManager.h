@@ -5,6 +5,7 @@
 #ifndef BAREMETAL_SRC_INCLUDE_EBBRT_EVENTMANAGER_H_
 #define BAREMETAL_SRC_INCLUDE_EBBRT_EVENTMANAGER_H_
 
+#include <atomic>
 #include <list>
 #include <mutex>
 #include <queue>
@@ -12,6 +13,7 @@
 #include <unordered_map>
 
 #include <boost/container/flat_map.hpp>
+#include <boost/intrusive/list.hpp>
 #include <boost/utility.hpp>
 
 #include "../MoveLambda.h"
@@ -23,9 +25,11 @@
 #include "Trans.h"
 #include "VMemAllocator.h"
 
+class EventStackFaultHandler;
+
 namespace ebbrt {
 
-class EventManager : Timer::Hook {
+class EventManager {
   typedef boost::container::flat_map<size_t, ebbrt::EventManager*> RepMap;
 
  public:
@@ -49,7 +53,11 @@ class EventManager : Timer::Hook {
     size_t cpu;
     size_t generation;
   };
-  class IdleCallback : boost::noncopyable {
+  // Invoked repeatedly while the core would otherwise halt. Several may be
+  // started on a core at once, they then take turns. Starting and stopping
+  // never allocates, and a callback may stop itself.
+  class IdleCallback : boost::noncopyable,
+                       public boost::intrusive::list_base_hook<> {
    public:
     template <typename F>
     explicit IdleCallback(F&& f) : f_(std::forward<F>(f)), started_(false) {}
@@ -60,13 +68,32 @@ class EventManager : Timer::Hook {
    private:
     std::function<void()> f_;
     bool started_;
+
+    friend class EventManager;
+  };
+
+  struct StealStats {
+    // tasks this core took from other cores
+    uint64_t steals;
+    // tasks other cores took from this core
+    uint64_t migrations;
   };
 
   explicit EventManager(const RepMap& rm);
 
   static void Init();
+  // Allow idle cores to run asynchronously spawned tasks queued on other
+  // cores. Context activations and tasks spawned with SpawnLocal or
+  // SpawnRemote stay on the core they were queued on.
+  static void EnableWorkStealing(bool enable = true);
   static EventManager& HandleFault(EbbId id);
 
+  // Run func as a new event on this core. Once EnableWorkStealing has been
+  // called, a task spawned with force_async may instead be run by another,
+  // idle core: it must not depend on which core it runs on (e.g. by caching
+  // Cpu::GetMine() or a reference to a per-core representative) nor on
+  // running in order with other tasks spawned here. Use SpawnLocal for tasks
+  // that need to stay on this core.
   void Spawn(ebbrt::MovableFunction<void()> func, bool force_async = false);
   void SpawnLocal(ebbrt::MovableFunction<void()> func,
                   bool force_async = false);
@@ -78,11 +105,36 @@ class EventManager : Timer::Hook {
   uint32_t GetEventId();
   std::unordered_map<__gthread_key_t, void*>& GetTlsMap();
   void DoRcu(MovableFunction<void()> func);
-  void Fire() override;
+  // Start a grace period immediately rather than waiting to batch up more
+  // callbacks
+  static void ExpediteRcu();
+  StealStats GetStealStats(size_t cpu) const;
+  // Number of times the core woke up from halt
+  uint64_t GetWakeupCount(size_t cpu) const;
+  // Return the pages backing this core's idle event stacks, they are faulted
+  // back in when a stack is reused
+  void ReleaseFreeStacks();
 
  private:
   template <typename F> void InvokeFunction(F&& f);
-  void AddRemoteTask(MovableFunction<void()> func);
+  // Remote tasks are allocated by the spawning core and handed back to it
+  // once run, so a core that spawns remotely at a steady rate stops
+  // allocating
+  struct RemoteTask {
+    explicit RemoteTask(EventManager* o) : origin(o) {}
+    RemoteTask* next = nullptr;
+    EventManager* origin;
+    MovableFunction<void()> func;
+  };
+
+  RemoteTask* AllocateRemoteTask();
+  static void FreeRemoteTask(RemoteTask* task);
+  bool AddRemoteTask(RemoteTask* task);
+  void DrainRemoteTasks();
+  void AddStealableTask(MovableFunction<void()> func);
+  bool TrySteal();
+  bool StealFrom(EventManager& victim);
+  void KickIdleCore();
   void StartProcessingEvents()
       __attribute__((noreturn, no_instrument_function));
   static void CallProcess(uintptr_t mgr)
@@ -94,29 +146,70 @@ class EventManager : Timer::Hook {
       __attribute__((noreturn, no_instrument_function));
   Pfn AllocateStack();
   void FreeStack(Pfn pfn);
-  void PassToken();
-  void ReceiveToken();
+  static void StartRcu();
+  static void StartGracePeriod();
+  static void CompleteGracePeriod();
+  void NoteGracePeriod();
   void CheckGeneration();
-  void StartTimer();
+  bool RcuQsReady();
+  void ReportQuiescentState();
+  bool RcuCallbacksReady();
+  void InvokeRcuCallbacks();
 
   const RepMap& reps_;
   std::stack<Pfn> free_stacks_;
+  std::unordered_map<Pfn, EventStackFaultHandler*> stack_handlers_;
   std::list<MovableFunction<void()>> tasks_;
   uint32_t next_event_id_;
   EventContext active_event_context_;
   std::stack<EventContext> sync_contexts_;
   MovableFunction<void()> sync_spawn_fn_;
-  std::function<void()>* idle_callback_ = nullptr;
+  boost::intrusive::list<IdleCallback> idle_callbacks_;
   size_t generation_ = 0;
   std::array<size_t, 2> generation_count_ = {{0}};
   size_t pending_generation_ = 0;
-  std::queue<MovableFunction<void()>> prev_rcu_tasks_;
-  std::queue<MovableFunction<void()>> curr_rcu_tasks_;
-
+  // grace period this core has most recently noticed
+  uint64_t rcu_gp_seen_ = 0;
+  // whether this core still owes a quiescent state for rcu_gp_seen_
+  bool rcu_qs_pending_ = false;
+  struct RcuCallback {
+    // grace period that must complete before the callback may run
+    uint64_t gp;
+    MovableFunction<void()> func;
+  };
+  std::queue<RcuCallback> rcu_callbacks_;
+  // delays the start of a grace period so callbacks queued close together
+  // share it
+  struct RcuGpTimer : Timer::Hook {
+    void Fire() override;
+    bool armed = false;
+  } rcu_gp_timer_;
+
+  // Multi-producer, single-consumer stack of tasks spawned by other cores
   struct RemoteData : CacheAligned {
+    std::atomic<RemoteTask*> head{nullptr};
+  } remote_;
+  // Remote tasks drained onto this core, oldest first
+  RemoteTask* remote_batch_head_ = nullptr;
+  RemoteTask** remote_batch_tail_ = &remote_batch_head_;
+  // Run tasks returned by other cores for this core to reuse
+  struct RemoteFreeData : CacheAligned {
+    std::atomic<RemoteTask*> head{nullptr};
+  } remote_free_;
+  RemoteTask* remote_free_local_ = nullptr;
+
+  struct StealableData : CacheAligned {
     ebbrt::SpinLock lock;
     std::list<MovableFunction<void()>> tasks;
-  } remote_;
+    std::atomic<size_t> size{0};
+    uint64_t migrations{0};
+  } stealable_;
+  uint64_t steals_ = 0;
+  std::atomic<bool> idle_{false};
+  // when this core was last woken to steal, in wall clock nanoseconds
+  std::atomic<int64_t> last_kick_{0};
+  bool halted_ = false;
+  uint64_t wakeups_ = 0;
 
   friend void ebbrt::idt::EventInterrupt(int num);
   friend void ebbrt::Main(ebbrt::multiboot::Information* mbi);
@@ -5,11 +5,14 @@
 #ifndef BAREMETAL_SRC_INCLUDE_EBBRT_GENERALPURPOSEALLOCATOR_H_
 #define BAREMETAL_SRC_INCLUDE_EBBRT_GENERALPURPOSEALLOCATOR_H_
 
+#include <algorithm>
 #include <array>
 
 #include "../CacheAligned.h"
 #include "CpuAsm.h"
+#include "Cpuid.h"
 #include "Debug.h"
+#include "MemPolicy.h"
 #include "SlabAllocator.h"
 #include "Trans.h"
 #include "VMemAllocator.h"
@@ -21,25 +24,29 @@ namespace ebbrt {
 class LargeRegionFaultHandler : public ebbrt::VMemAllocator::PageFaultHandler {
   std::vector<ebbrt::Pfn> vecPfns;
   uintptr_t sAddr;  // start addr of region
+  size_t pageSize = pmem::kLargePageSize;  // 2Mb or 1Gb
 
  public:
   void SetAddr(uintptr_t s) { sAddr = s; }
   void SetVec(std::vector<ebbrt::Pfn> m) { vecPfns = std::move(m); }
+  void SetPageSize(size_t size) { pageSize = size; }
 
   // given faulted address, calculates virtual page frame and finds
   // corresponding physical page frame in tmap table, then calls
   // MapMemory to do actual mapping
   void HandleFault(ebbrt::idt::ExceptionFrame* ef,
                    uintptr_t faulted_address) override {
-    auto vpage = ebbrt::Pfn::LDown(faulted_address);
-
-    // calculate number of 2Mb pages from sAddr to
+    // calculate number of pages from sAddr to
     // use as index to Pfns
-    auto mAddr = vpage.ToLAddr();
+    auto mAddr = align::Down(faulted_address, pageSize);
     kassert(mAddr >= sAddr);
-    auto index = (mAddr - sAddr) / pmem::kLargePageSize;
+    auto index = (mAddr - sAddr) / pageSize;
     kassert(index < vecPfns.size());
-    ebbrt::vmem::MapMemoryLarge(mAddr, vecPfns[index], pmem::kLargePageSize);
+    if (pageSize == pmem::kHugePageSize) {
+      ebbrt::vmem::MapMemoryHuge(mAddr, vecPfns[index], pageSize);
+    } else {
+      ebbrt::vmem::MapMemoryLarge(mAddr, vecPfns[index], pageSize);
+    }
   }
 };
 
@@ -71,6 +78,14 @@ class GeneralPurposeAllocator : public CacheAligned {
     }
   }
 
+  static constexpr size_t NumSizeClasses() { return sizeof...(sizes_in); }
+
+  // The slab allocator backing a size class, used for gathering statistics
+  static SlabAllocatorRoot& SizeClassRoot(size_t index) {
+    kassert(index < sizeof...(sizes_in));
+    return *allocator_roots[index];
+  }
+
   void* operator new(size_t size) {
     auto& allocator = rep_allocator->GetCpuAllocator();
     auto ret = allocator.Alloc();
@@ -83,100 +98,37 @@ class GeneralPurposeAllocator : public CacheAligned {
 
   void operator delete(void* p) { EBBRT_UNIMPLEMENTED(); }
 
-  void* Alloc(size_t size) {
+  // Allocations without an explicit policy (including malloc and new) follow
+  // this core's policy, see MemPolicyScope
+  void* Alloc(size_t size) { return Alloc(size, policy_); }
+
+  void* Alloc(size_t size, const MemPolicy& policy) {
     Indexer<0, sizes_in...> i;
     auto index = i(size);
     if (likely(index != -1)) {
-      auto ret = allocators_[index]->Alloc();
-      kbugon(ret == nullptr,
-             "Failed to allocate from this NUMA node, should try others\n");
-      return ret;
+      return AllocObject(index, policy);
     }
-    const constexpr size_t large_page_size = 2 * 1024 * 1024;
-    const constexpr size_t large_page_order = 9;
-    auto sz = align::Up(size, large_page_size);
-    auto npages = sz / pmem::kPageSize;
-    auto pages_per_large_page = large_page_size / pmem::kPageSize;
-
-    auto pf = std::make_unique<LargeRegionFaultHandler>();
-    auto& ref = *pf;  // keep reference for update later
-    std::vector<ebbrt::Pfn> vecPfns;
-
-    // Need to allocate a virtual region
-    auto vfn =
-        vmem_allocator->Alloc(npages, pages_per_large_page, std::move(pf));
-    kbugon(vfn == Pfn::None(), "Failed to allocated virtual region\n");
-    auto pte_root = vmem::Pte(ReadCr3());
-    auto vaddr = vfn.ToAddr();
-
-    vmem::TraversePageTable(
-        pte_root, vaddr, vaddr + sz, 0, 4,
-        [&vecPfns](vmem::Pte& entry, uint64_t base_virt, size_t level) {
-          kassert(!entry.Present() && level == 1);
-          auto pfn = page_allocator->Alloc(large_page_order);
-          kbugon(pfn == Pfn::None(),
-                 "Failed to allocate page in gp allocator\n");
-          vecPfns.emplace_back(pfn);  // store pfn
-          entry.SetLarge(pfn.ToAddr());
-          std::atomic_thread_fence(std::memory_order_release);
-        },
-        [](vmem::Pte& entry) {
-          auto page = page_allocator->Alloc();
-          kbugon(page == Pfn::None(),
-                 "Failed to allocate page in gp allocator\n");
-          auto page_addr = page.ToAddr();
-          new (reinterpret_cast<void*>(page_addr)) vmem::Pte[512];
-          entry.SetNormal(page_addr);
-          return true;
-        });
+    return AllocRegion(size, pmem::kLargePageShift, policy);
+  }
 
-    // updates page fault handler for large memory regions
-    ref.SetAddr(vaddr);
-    ref.SetVec(std::move(vecPfns));
+  // Allocate a region backed by 1GB pages, for very large allocations such as
+  // in-memory tables. The size is rounded up to a whole number of pages. Falls
+  // back to 2MB pages if the cpu does not support 1GB pages.
+  void* AllocHuge(size_t size) { return AllocHuge(size, policy_); }
 
-    return reinterpret_cast<void*>(vaddr);
+  void* AllocHuge(size_t size, const MemPolicy& policy) {
+    if (!cpuid::features.pdpe1gb)
+      return AllocRegion(size, pmem::kLargePageShift, policy);
+    return AllocRegion(size, pmem::kHugePageShift, policy);
   }
 
   void* Alloc(size_t size, size_t alignment) {
     Indexer<0, sizes_in...> i;
     auto index = i(size);
     if (likely(index != -1)) {
-      auto ret = allocators_[index]->Alloc();
-      kbugon(ret == nullptr,
-             "Failed to allocate from this NUMA node, should try others\n");
-      return ret;
+      return AllocObject(index, policy_);
     }
-    const constexpr size_t large_page_size = 2 * 1024 * 1024;
-    const constexpr size_t large_page_order = 9;
-    auto sz = align::Up(size, large_page_size);
-    auto npages = sz / pmem::kPageSize;
-    auto align = align::Up(alignment, large_page_size);
-    auto align_pages = align / pmem::kPageSize;
-    // Need to allocate a virtual region
-    auto vfn = vmem_allocator->Alloc(npages, align_pages);
-    kbugon(vfn == Pfn::None(), "Failed to allocated virtual region\n");
-    auto pte_root = vmem::Pte(ReadCr3());
-    auto vaddr = vfn.ToAddr();
-    vmem::TraversePageTable(
-        pte_root, vaddr, vaddr + sz, 0, 4,
-        [](vmem::Pte& entry, uint64_t base_virt, size_t level) {
-          kassert(!entry.Present() && level == 1);
-          auto pfn = page_allocator->Alloc(large_page_order);
-          kbugon(pfn == Pfn::None(),
-                 "Failed to allocate page in gp allocator\n");
-          entry.SetLarge(pfn.ToAddr());
-          std::atomic_thread_fence(std::memory_order_release);
-        },
-        [](vmem::Pte& entry) {
-          auto page = page_allocator->Alloc();
-          kbugon(page == Pfn::None(),
-                 "Failed to allocate page in gp allocator\n");
-          auto page_addr = page.ToAddr();
-          new (reinterpret_cast<void*>(page_addr)) vmem::Pte[512];
-          entry.SetNormal(page_addr);
-          return true;
-        });
-    return reinterpret_cast<void*>(vaddr);
+    return AllocRegion(size, pmem::kLargePageShift, policy_, alignment);
   }
 
   void* AllocNid(size_t size, Nid nid = Cpu::GetMyNode()) {
@@ -189,6 +141,9 @@ class GeneralPurposeAllocator : public CacheAligned {
     return ret;
   }
 
+  const MemPolicy& GetPolicy() const { return policy_; }
+  void SetPolicy(const MemPolicy& policy) { policy_ = policy; }
+
   void Free(void* p) {
     if (p == nullptr)
       return;
@@ -204,6 +159,86 @@ class GeneralPurposeAllocator : public CacheAligned {
   }
 
  private:
+  void* AllocObject(size_t index, const MemPolicy& policy) {
+    if (likely(policy.mode() == MemPolicy::Mode::kLocal)) {
+      auto ret = allocators_[index]->Alloc();
+      kbugon(ret == nullptr,
+             "Failed to allocate from this NUMA node, should try others\n");
+      return ret;
+    }
+
+    auto nid = policy.Node(interleave_next_++);
+    auto ret = allocators_[index]->AllocNid(nid);
+    for (size_t i = 0; ret == nullptr && i < numa::nodes->size(); ++i) {
+      if (Nid(i) != nid && policy.Allowed(Nid(i)))
+        ret = allocators_[index]->AllocNid(Nid(i));
+    }
+    kbugon(ret == nullptr, "Failed to allocate under memory policy\n");
+    return ret;
+  }
+
+  // Pages for a large region, placed by the policy and falling back to the
+  // other nodes it allows
+  Pfn AllocPages(size_t order, const MemPolicy& policy) {
+    auto nid = policy.Node(interleave_next_++);
+    auto pfn = page_allocator->Alloc(order, nid);
+    for (size_t i = 0; pfn == Pfn::None() && i < numa::nodes->size(); ++i) {
+      if (Nid(i) != nid && policy.Allowed(Nid(i)))
+        pfn = page_allocator->Alloc(order, Nid(i));
+    }
+    return pfn;
+  }
+
+  // Back a virtual region with pages of 1 << page_shift bytes, mapped on this
+  // core now and on other cores as they fault. The pages are placed according
+  // to the policy when the region is created, the fault handler only maps
+  // them.
+  // The region is aligned to its page size, or to alignment if that is larger
+  void* AllocRegion(size_t size, size_t page_shift, const MemPolicy& policy,
+                    size_t alignment = 0) {
+    auto page_size = size_t(1) << page_shift;
+    auto page_order = page_shift - pmem::kPageShift;
+    auto sz = align::Up(size, page_size);
+    auto npages = sz / pmem::kPageSize;
+    auto align_pages = align::Up(std::max(alignment, page_size), page_size) /
+                       pmem::kPageSize;
+    auto num_page_sizes = page_shift == pmem::kHugePageShift
+                              ? vmem::kMaxPageSizes
+                              : vmem::kNumPageSizes;
+    auto page_level = page_order / 9;
+
+    auto pf = std::make_unique<LargeRegionFaultHandler>();
+    auto& ref = *pf;  // keep reference for update later
+    std::vector<ebbrt::Pfn> vecPfns;
+
+    // Need to allocate a virtual region
+    auto vfn = vmem_allocator->Alloc(npages, align_pages, std::move(pf));
+    kbugon(vfn == Pfn::None(), "Failed to allocated virtual region\n");
+    auto pte_root = vmem::Pte(ReadCr3());
+    auto vaddr = vfn.ToAddr();
+
+    vmem::TraversePageTable(
+        pte_root, vaddr, vaddr + sz, 0, 4,
+        [this, &vecPfns, &policy, page_order, page_level](
+            vmem::Pte& entry, uint64_t base_virt, size_t level) {
+          kassert(!entry.Present() && level == page_level);
+          auto pfn = AllocPages(page_order, policy);
+          kbugon(pfn == Pfn::None(),
+                 "Failed to allocate page in gp allocator\n");
+          vecPfns.emplace_back(pfn);  // store pfn
+          entry.SetLarge(pfn.ToAddr());
+          std::atomic_thread_fence(std::memory_order_release);
+        },
+        vmem::InstallTable, num_page_sizes);
+
+    // updates page fault handler for large memory regions
+    ref.SetAddr(vaddr);
+    ref.SetPageSize(page_size);
+    ref.SetVec(std::move(vecPfns));
+
+    return reinterpret_cast<void*>(vaddr);
+  }
+
   template <size_t index, size_t... tail> struct Construct {
     void
     operator()(std::array<SlabAllocatorRoot*, sizeof...(sizes_in)>& roots) {}
@@ -243,6 +278,9 @@ class GeneralPurposeAllocator : public CacheAligned {
   static std::array<GeneralPurposeAllocator<sizes_in...>*, Cpu::kMaxCpus> reps;
   static SlabAllocatorRoot* rep_allocator;
   std::array<SlabAllocator*, sizeof...(sizes_in)> allocators_;
+  MemPolicy policy_;
+  // spreads interleaved allocations over the nodes of the policy
+  size_t interleave_next_ = 0;
 };
 
 template <size_t... sizes_in>
@@ -265,6 +303,26 @@ typedef GeneralPurposeAllocator<
 
 constexpr auto gp_allocator =
     EbbRef<GeneralPurposeAllocatorType>(kGpAllocatorId);
+
+// Applies a memory policy to everything allocated on this core, including
+// through malloc and new, until the scope ends. An Ebb can place its memory
+// according to its own policy by opening a scope in its methods. The policy
+// belongs to the core rather than the event, so a scope must not span a
+// blocking call.
+class MemPolicyScope {
+ public:
+  explicit MemPolicyScope(const MemPolicy& policy)
+      : saved_(gp_allocator->GetPolicy()) {
+    gp_allocator->SetPolicy(policy);
+  }
+  ~MemPolicyScope() { gp_allocator->SetPolicy(saved_); }
+
+  MemPolicyScope(const MemPolicyScope&) = delete;
+  MemPolicyScope& operator=(const MemPolicyScope&) = delete;
+
+ private:
+  MemPolicy saved_;
+};
 }  // namespace ebbrt
 
 #endif  // BAREMETAL_SRC_INCLUDE_EBBRT_GENERALPURPOSEALLOCATOR_H_
@@ -145,7 +145,10 @@ ebbrt::Main(multiboot::Information* mbi) {
         apic::PVEoiInit(0);
         Timer::Init();
         smp::Init();
-        event_manager->ReceiveToken();
+        EventManager::StartRcu();
+        PageAllocator::EnableShrinking();
+        PageAllocator::EnablePreZeroing();
+        vmem_allocator->EnableRcu();
 #ifdef __EBBRT_ENABLE_NETWORKING__
         NetworkManager::Init();
         pci::Init();
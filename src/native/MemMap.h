@@ -35,7 +35,9 @@ struct Page {
     kReserved,
     kPageAllocator,
     kSlabAllocator,
-    kInUse
+    kInUse,
+    // holds a UniqueIOBuf carved from a zeroed page
+    kIOBuf
   } usage;
 
   explicit Page(Nid nid) : usage(Usage::kReserved), nid(nid.val()) {}
@@ -0,0 +1,65 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "MemPolicy.h"
+
+#include "Cpu.h"
+#include "Debug.h"
+
+ebbrt::MemPolicy::MemPolicy(Mode mode, const NodeMask& nodes)
+    : mode_(mode), nodes_(nodes & AllNodes()) {
+  kbugon(nodes_.none(), "Memory policy without any nodes\n");
+}
+
+ebbrt::MemPolicy ebbrt::MemPolicy::Preferred(Nid nid) {
+  NodeMask nodes;
+  nodes.set(nid.val());
+  return MemPolicy(Mode::kPreferred, nodes);
+}
+
+ebbrt::MemPolicy ebbrt::MemPolicy::Bind(Nid nid) {
+  NodeMask nodes;
+  nodes.set(nid.val());
+  return MemPolicy(Mode::kBind, nodes);
+}
+
+ebbrt::MemPolicy ebbrt::MemPolicy::Bind(const NodeMask& nodes) {
+  return MemPolicy(Mode::kBind, nodes);
+}
+
+ebbrt::MemPolicy ebbrt::MemPolicy::Interleave() {
+  return MemPolicy(Mode::kInterleave, AllNodes());
+}
+
+ebbrt::MemPolicy ebbrt::MemPolicy::Interleave(const NodeMask& nodes) {
+  return MemPolicy(Mode::kInterleave, nodes);
+}
+
+ebbrt::MemPolicy::NodeMask ebbrt::MemPolicy::AllNodes() {
+  NodeMask nodes;
+  for (size_t i = 0; i < numa::nodes->size(); ++i) {
+    nodes.set(i);
+  }
+  return nodes;
+}
+
+ebbrt::Nid ebbrt::MemPolicy::Node(size_t n) const {
+  if (mode_ == Mode::kLocal)
+    return Cpu::GetMyNode();
+
+  if (mode_ == Mode::kBind && nodes_.test(Cpu::GetMyNode().val()))
+    return Cpu::GetMyNode();
+
+  // preferred and bind take the first node of the mask, interleave takes the
+  // (n % count)-th
+  auto skip = mode_ == Mode::kInterleave ? n % nodes_.count() : 0;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    if (!nodes_.test(i))
+      continue;
+    if (skip == 0)
+      return Nid(i);
+    --skip;
+  }
+  kabort("Memory policy without any nodes\n");
+}
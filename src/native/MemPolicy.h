@@ -0,0 +1,57 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BAREMETAL_SRC_INCLUDE_EBBRT_MEMPOLICY_H_
+#define BAREMETAL_SRC_INCLUDE_EBBRT_MEMPOLICY_H_
+
+#include <bitset>
+#include <cstdint>
+
+#include "../Nid.h"
+#include "Numa.h"
+
+namespace ebbrt {
+
+// Which NUMA nodes the general purpose allocator takes memory from.
+//  - Local: the node of the allocating core (the default)
+//  - Preferred: a given node, falling back to the others when it is out of
+//    memory
+//  - Bind: only the given nodes, the allocating core's node first if it is
+//    one of them
+//  - Interleave: round robin over the given nodes, per object for small
+//    allocations and per page for large regions
+class MemPolicy {
+ public:
+  enum class Mode : uint8_t { kLocal, kPreferred, kBind, kInterleave };
+  typedef std::bitset<numa::kMaxNodes> NodeMask;
+
+  MemPolicy() : mode_(Mode::kLocal) {}
+
+  static MemPolicy Local() { return MemPolicy(); }
+  static MemPolicy Preferred(Nid nid);
+  static MemPolicy Bind(Nid nid);
+  static MemPolicy Bind(const NodeMask& nodes);
+  static MemPolicy Interleave();
+  static MemPolicy Interleave(const NodeMask& nodes);
+  static NodeMask AllNodes();
+
+  Mode mode() const { return mode_; }
+  // The node to try first for the n-th object or page allocated under this
+  // policy
+  Nid Node(size_t n) const;
+  // Whether memory may be taken from the node, once the first choice is
+  // exhausted
+  bool Allowed(Nid nid) const {
+    return mode_ != Mode::kBind || nodes_.test(nid.val());
+  }
+
+ private:
+  MemPolicy(Mode mode, const NodeMask& nodes);
+
+  Mode mode_;
+  NodeMask nodes_;
+};
+}  // namespace ebbrt
+
+#endif  // BAREMETAL_SRC_INCLUDE_EBBRT_MEMPOLICY_H_
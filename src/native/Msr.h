@@ -8,6 +8,7 @@
 namespace ebbrt {
 namespace msr {
 const constexpr uint32_t kIa32ApicBase = 0x0000001b;
+const constexpr uint32_t kIa32TscDeadline = 0x000006e0;
 const constexpr uint32_t kX2apicIdr = 0x00000802;
 const constexpr uint32_t kX2apicEoi = 0x0000080b;
 const constexpr uint32_t kX2apicSvr = 0x0000080f;
@@ -22,6 +22,7 @@
 #include "NetEth.h"
 #include "NetIp.h"
 #include "NetTcp.h"
+#include "NetTcpCongestion.h"
 #include "RcuTable.h"
 #include "SharedPoolAllocator.h"
 
@@ -88,6 +89,8 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
     std::unique_ptr<MutIOBuf> buf;
     TcpHeader& th;
     uint16_t tcp_len;
+    bool sacked{false};  // the receiver has selectively acknowledged it
+    bool retransmitted{false};  // resent during the current fast recovery
   };
 
   class TcpPcb;
@@ -97,6 +100,7 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
                std::unique_ptr<MutIOBuf> buf);
     RcuHListHook hook;
     uint16_t port{0};
+    uint32_t rcv_wnd{kTcpWnd};  // receive window of accepted connections
     MovableFunction<void(TcpPcb)> accept_fn;
   };
 
@@ -104,6 +108,7 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
    public:
     ListeningTcpPcb() : entry_{new ListeningTcpEntry()} {}
     uint16_t Bind(uint16_t port, MovableFunction<void(TcpPcb)> accept);
+    void SetReceiveWindow(uint32_t wnd);
 
    private:
     struct ListeningTcpEntryDeleter {
@@ -128,6 +133,8 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
     void Fire() override;
     void EnqueueSegment(TcpHeader& th, std::unique_ptr<MutIOBuf> buf,
                         uint16_t flags, uint16_t optlen = 0);
+    void EnqueueSyn(uint16_t flags, bool window_scale, bool sack_permitted,
+                    bool timestamps);
     void Input(const Ipv4Header& ih, TcpHeader& th, TcpInfo& info,
                std::unique_ptr<MutIOBuf> buf);
     bool Receive(const Ipv4Header& ih, TcpHeader& th, TcpInfo& info,
@@ -136,9 +143,18 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
     size_t Output(ebbrt::clock::Wall::time_point now);
     void ClearAckedSegments(const TcpInfo& info);
     size_t SendWindowRemaining();
+    uint32_t FlightSize();
     void SetTimer(ebbrt::clock::Wall::time_point now);
     void SendSegment(TcpSegment& segment);
     void SendEmptyAck();
+    size_t SackBlocks(TcpSackBlock* blocks, size_t max);
+    void ProcessSack(const TcpOptions& options);
+    bool RetransmitHole();
+    void Retransmit(TcpSegment& segment);
+    void RttAck(const TcpOptions& options, uint32_t ackno,
+                ebbrt::clock::Wall::time_point now);
+    void RttSample(std::chrono::microseconds rtt);
+    void SetTimestamps(TcpHeader& th, ebbrt::clock::Wall::time_point now);
     void Close();
     void SendFin();
     void Send(std::unique_ptr<IOBuf> buf);
@@ -173,10 +189,29 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
     uint32_t rcv_nxt;  // next sequence number expected on an incoming segment,
     // also the lower edge of the receive window
     uint32_t rcv_wnd;  // size of the receive window
+    uint32_t rcv_wnd_max{kTcpWnd};  // size of the receive window when open
+    uint8_t snd_wnd_shift{0};  // window scale of the remote side
+    uint8_t rcv_wnd_shift{0};  // window scale we advertise with
+    bool sack_ok{false};  // both sides agreed to use SACK
+    uint32_t sack_high;  // highest sequence number SACKed by the remote side
+    uint32_t stash_recent;  // sequence number of the last segment stashed
+    uint32_t snd_max;  // highest sequence number sent
+    bool ts_ok{false};  // both sides agreed to use timestamps
+    uint32_t ts_recent{0};  // timestamp to echo to the remote side
+    // Without timestamps one segment at a time is timed (RFC 6298 3)
+    bool rtt_timing{false};
+    uint32_t rtt_seq;  // ack that ends the timing
+    ebbrt::clock::Wall::time_point rtt_start;
+    TcpRttStats rtt;
     uint32_t rcv_last_acked;  // The last received byte we acked
     bool close_window{false};
+    std::unique_ptr<TcpCongestionControl> cc{new TcpNewReno(kTcpMss)};
     ebbrt::clock::Wall::time_point retransmit;  // when to retransmit
     ebbrt::clock::Wall::time_point time_wait;  // when to leave time_wait state
+    ebbrt::clock::Wall::time_point delayed_ack;  // when to send a held ACK
+    ebbrt::clock::Wall::time_point timer_deadline;  // when the timer fires
+    bool ack_now{false};  // the next Output() must acknowledge received data
+    bool quick_ack{false};  // never delay ACKs
     Promise<void> connected;
     std::unique_ptr<ITcpHandler> handler;
     std::atomic_bool accepted{false};
@@ -195,7 +230,11 @@ class NetworkManager : public StaticSharedEbb<NetworkManager> {
     size_t SendWindowRemaining();
     void OpenWindow();
     void CloseWindow();
+    void SetReceiveWindow(uint32_t wnd);
+    TcpRttStats GetRttStats();
+    void SetQuickAck(bool quick);
     void SetWindowNotify(bool notify);
+    void SetCongestionControl(std::unique_ptr<TcpCongestionControl> cc);
     void Send(std::unique_ptr<IOBuf> buf);
     void Output();
     Ipv4Address GetRemoteAddress();
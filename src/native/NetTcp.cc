@@ -59,6 +59,11 @@ uint16_t ebbrt::NetworkManager::ListeningTcpPcb::Bind(
   return port;
 }
 
+// Set the receive window of connections accepted from now on
+void ebbrt::NetworkManager::ListeningTcpPcb::SetReceiveWindow(uint32_t wnd) {
+  entry_->rcv_wnd = std::min(wnd, kTcpMaxWnd);
+}
+
 uint16_t ebbrt::NetworkManager::TcpPcb::Connect(Ipv4Address address,
                                                 uint16_t port,
                                                 uint16_t local_port) {
@@ -88,11 +93,16 @@ uint16_t ebbrt::NetworkManager::TcpPcb::Connect(Ipv4Address address,
   entry_->state = TcpEntry::State::kSynSent;
   uint32_t iss = random::Get();
   entry_->snd_una = iss;
+  entry_->sack_high = iss;
+  entry_->snd_max = iss;
   entry_->snd_nxt = iss;  // EnqueueSegment will increment this by one
   // We should wait to hear back from our Syn before setting this
   entry_->snd_wnd = kTcpWnd;
   entry_->rcv_nxt = 0;
-  entry_->rcv_wnd = kTcpWnd;
+  entry_->rcv_wnd = entry_->rcv_wnd_max;
+  // Offer a scale large enough for our window, it is only used if the remote
+  // side offers one too
+  entry_->rcv_wnd_shift = TcpWindowShift(entry_->rcv_wnd_max);
 
   // We need to insert the entry into the hash table at this point to avoid
   // concurrent connection creation.
@@ -116,20 +126,8 @@ uint16_t ebbrt::NetworkManager::TcpPcb::Connect(Ipv4Address address,
   // TODO(dschatz): There should be a timeout to close the new connection if
   // the handshake doesn't complete
 
-  auto optlen = 8;  // for MSS + NOP + WS
-  auto new_buf = MakeUniqueIOBuf(optlen + sizeof(TcpHeader) +
-                                 sizeof(Ipv4Header) + sizeof(EthernetHeader));
-  new_buf->Advance(sizeof(Ipv4Header) + sizeof(EthernetHeader));
-  auto dp = new_buf->GetMutDataPointer();
-  auto& tcp_header = dp.Get<TcpHeader>();
-  auto opts = reinterpret_cast<uint32_t*>((&tcp_header) + 1);
-  *opts = htonl(0x02040000 | (1460 & 0xFFFF));
-  auto nop_ptr = reinterpret_cast<uint8_t*>(opts+1);
-  nop_ptr[0] = 0x1; // NOP
-  nop_ptr[1] = 0x3; // WS type
-  nop_ptr[2] = 0x3; // opt length
-  nop_ptr[3] = kWindowShift; // shift value
-  entry_->EnqueueSegment(tcp_header, std::move(new_buf), kTcpSyn, optlen);
+  entry_->EnqueueSyn(kTcpSyn, /* window_scale = */ true,
+                     /* sack_permitted = */ true, /* timestamps = */ true);
 
   auto now = ebbrt::clock::Wall::Now();
   entry_->Output(now);
@@ -140,13 +138,25 @@ uint16_t ebbrt::NetworkManager::TcpPcb::Connect(Ipv4Address address,
 
 void ebbrt::NetworkManager::TcpPcb::OpenWindow() {
   entry_->close_window = false;
-  entry_->rcv_wnd = kTcpWnd;
+  entry_->rcv_wnd = entry_->rcv_wnd_max;
 }
 
 void ebbrt::NetworkManager::TcpPcb::CloseWindow() {
   entry_->close_window = true;
 }
 
+// Set the size of the receive window. Called before Connect() this also picks
+// the window scale offered to the remote side, afterwards the window cannot
+// grow past what the negotiated scale can advertise
+void ebbrt::NetworkManager::TcpPcb::SetReceiveWindow(uint32_t wnd) {
+  wnd = std::min(wnd, kTcpMaxWnd);
+  if (entry_->state != TcpEntry::State::kClosed)
+    wnd = std::min(wnd, static_cast<uint32_t>(0xFFFF) << entry_->rcv_wnd_shift);
+  entry_->rcv_wnd_max = wnd;
+  if (!entry_->close_window)
+    entry_->rcv_wnd = wnd;
+}
+
 // Bind this connection to a core
 void ebbrt::NetworkManager::TcpPcb::BindCpu(size_t index) {
   entry_->cpu = index;
@@ -164,11 +174,33 @@ size_t ebbrt::NetworkManager::TcpPcb::SendWindowRemaining() {
   return entry_->SendWindowRemaining();
 }
 
+// Round trip time estimates and retransmission timeout of the connection
+ebbrt::TcpRttStats ebbrt::NetworkManager::TcpPcb::GetRttStats() {
+  return entry_->rtt;
+}
+
+// Enable/Disable quick ACKs. By default an ACK is only sent for every second
+// full-size segment received, or when the delayed ACK timer fires, unless it
+// can ride along with outgoing data. Interactive flows may prefer every
+// segment to be acknowledged at once
+void ebbrt::NetworkManager::TcpPcb::SetQuickAck(bool quick) {
+  entry_->quick_ack = quick;
+}
+
 // Enable/Disable window change notifications
 void ebbrt::NetworkManager::TcpPcb::SetWindowNotify(bool notify) {
   entry_->window_notify = notify;
 }
 
+// Replace the congestion control algorithm of the connection (NewReno by
+// default). This should be done before Connect() or from the accept callback,
+// the new algorithm starts over from its initial window
+void ebbrt::NetworkManager::TcpPcb::SetCongestionControl(
+    std::unique_ptr<TcpCongestionControl> cc) {
+  kassert(cc);
+  entry_->cc = std::move(cc);
+}
+
 // Send TCP data on a connection. The user must ensure that the remote
 // window is large enough as the PCB will do no buffering
 void ebbrt::NetworkManager::TcpPcb::Send(std::unique_ptr<IOBuf> buf) {
@@ -295,36 +327,56 @@ void ebbrt::NetworkManager::TcpEntry::Fire() {
   // timer and move all unacked segments to pending
   if (retransmit != ebbrt::clock::Wall::time_point() && now >= retransmit) {
     retransmit = ebbrt::clock::Wall::time_point();
+    if (!unacked_segments.empty()) {
+      cc->OnRetransmitTimeout(snd_una + FlightSize(), FlightSize(), now);
+    }
+    // RFC 6298 5.5: Back off the timer, Karn's algorithm forbids timing the
+    // segments about to be resent
+    rtt.rto = std::min(rtt.rto * 2, kTcpMaxRto);
+    ++rtt.timeouts;
+    rtt_timing = false;
     // Move all unacked segments to the front of the pending segments queue
     pending_segments.splice(pending_segments.begin(),
                             std::move(unacked_segments));
   }
 
+  // A held ACK is due, Output() sends it unless data carries it
+  if (delayed_ack != ebbrt::clock::Wall::time_point() && now >= delayed_ack) {
+    delayed_ack = ebbrt::clock::Wall::time_point();
+    ack_now = true;
+  }
+
   // Try to send what we can
   Output(now);
   // Set the timer if we have to
   SetTimer(now);
 }
 
-// Set the timer if it is not already set and we have the need to
+// Set the timer for the earliest deadline we have, unless it is already set to
+// fire no later than that
 void ebbrt::NetworkManager::TcpEntry::SetTimer(
     ebbrt::clock::Wall::time_point now) {
-  if (timer_set)
-    return;
-
   ebbrt::clock::Wall::time_point min_timer;
-  if (now >= retransmit && now >= time_wait) {
+  for (auto deadline : {retransmit, time_wait, delayed_ack}) {
+    if (now < deadline &&
+        (min_timer == ebbrt::clock::Wall::time_point() || deadline < min_timer))
+      min_timer = deadline;
+  }
+
+  if (min_timer == ebbrt::clock::Wall::time_point())
     return;
-  } else if (now >= retransmit) {
-    min_timer = time_wait;
-  } else {
-    min_timer = retransmit;
+
+  if (timer_set) {
+    if (timer_deadline <= min_timer)
+      return;
+    timer->Stop(*this);
   }
 
   auto duration =
       std::chrono::duration_cast<std::chrono::microseconds>(min_timer - now);
   timer->Start(*this, duration, /* repeat = */ false);
   timer_set = true;
+  timer_deadline = min_timer;
 }
 
 // Turn off all timers
@@ -337,6 +389,7 @@ void ebbrt::NetworkManager::TcpEntry::DisableTimers() {
 
   retransmit = ebbrt::clock::Wall::time_point();
   time_wait = ebbrt::clock::Wall::time_point();
+  delayed_ack = ebbrt::clock::Wall::time_point();
 }
 
 // Purge all outstanding segments (either pending or unacked)
@@ -354,6 +407,71 @@ void ebbrt::NetworkManager::TcpEntry::Destroy() {
   event_manager->DoRcu([this]() { delete this; });
 }
 
+namespace {
+// Parse the options of a segment, a malformed option ends the parsing
+ebbrt::TcpOptions ParseTcpOptions(const ebbrt::TcpHeader& th) {
+  ebbrt::TcpOptions options;
+  auto p = reinterpret_cast<const uint8_t*>(th.options);
+  auto end = reinterpret_cast<const uint8_t*>(&th) + th.HdrLen();
+  while (p < end) {
+    auto kind = p[0];
+    if (kind == ebbrt::kTcpOptEnd)
+      break;
+    if (kind == ebbrt::kTcpOptNop) {
+      ++p;
+      continue;
+    }
+    if (end - p < 2 || p[1] < 2 || p[1] > end - p)
+      break;
+    auto len = p[1];
+    switch (kind) {
+    case ebbrt::kTcpOptMss:
+      if (len == 4) {
+        options.mss_ok = true;
+        options.mss = (p[2] << 8) | p[3];
+      }
+      break;
+    case ebbrt::kTcpOptWindowScale:
+      if (len == 3) {
+        // RFC 7323 2.3: a shift larger than 14 is treated as 14
+        options.window_scale_ok = true;
+        options.window_shift = std::min(p[2], ebbrt::kTcpMaxWindowShift);
+      }
+      break;
+    case ebbrt::kTcpOptSackPermitted:
+      if (len == 2)
+        options.sack_permitted = true;
+      break;
+    case ebbrt::kTcpOptSack:
+      for (auto b = p + 2; b + 8 <= p + len &&
+                           options.sack_blocks < ebbrt::kTcpMaxSackBlocks;
+           b += 8) {
+        auto& block = options.sack[options.sack_blocks++];
+        block.begin = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+        block.end = (b[4] << 24) | (b[5] << 16) | (b[6] << 8) | b[7];
+      }
+      break;
+    case ebbrt::kTcpOptTimestamp:
+      if (len == 10) {
+        options.timestamp_ok = true;
+        options.tsval = (p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+        options.tsecr = (p[6] << 24) | (p[7] << 16) | (p[8] << 8) | p[9];
+      }
+      break;
+    }
+    p += len;
+  }
+  return options;
+}
+
+// Our timestamp clock ticks once per millisecond (RFC 7323 5.4)
+uint32_t TcpTimestamp(ebbrt::clock::Wall::time_point now) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now.time_since_epoch())
+      .count();
+}
+}  // namespace
+
 // Input tcp segment to a listening PCB
 void ebbrt::NetworkManager::ListeningTcpEntry::Input(
     const Ipv4Header& ih, TcpHeader& th, TcpInfo& info,
@@ -414,26 +532,29 @@ void ebbrt::NetworkManager::ListeningTcpEntry::Input(
     entry->rcv_nxt = info.seqno + 1;
 
     entry->snd_una = start_seq;
-    // TODO(dschatz): Read the window shift from the options!!!
-    entry->snd_wnd = ntohs(th.wnd) << kWindowShift;
-    entry->rcv_wnd = kTcpWnd;
-
-    // Create a SYN-ACK reply
-    auto optlen = 8;  // for MSS + NOP + WS
-    auto new_buf = MakeUniqueIOBuf(optlen + sizeof(TcpHeader) +
-                                   sizeof(Ipv4Header) + sizeof(EthernetHeader));
-    new_buf->Advance(sizeof(Ipv4Header) + sizeof(EthernetHeader));
-    auto dp = new_buf->GetMutDataPointer();
-    auto& tcp_header = dp.Get<TcpHeader>();
-    auto opts = reinterpret_cast<uint32_t*>((&tcp_header) + 1);
-    *opts = htonl(0x02040000 | (1460 & 0xFFFF));
-    auto nop_ptr = reinterpret_cast<uint8_t*>(opts+1);
-    nop_ptr[0] = 0x1; // NOP
-    nop_ptr[1] = 0x3; // WS type
-    nop_ptr[2] = 0x3; // opt length
-    nop_ptr[3] = kWindowShift; // shift value
-    entry->EnqueueSegment(tcp_header, std::move(new_buf), kTcpSyn | kTcpAck,
-                          optlen);
+    entry->sack_high = start_seq;
+    entry->snd_max = start_seq;
+    // RFC 7323 2.2: The window field in a SYN segment itself is never scaled
+    entry->snd_wnd = ntohs(th.wnd);
+    auto options = ParseTcpOptions(th);
+    if (options.window_scale_ok) {
+      entry->snd_wnd_shift = options.window_shift;
+      entry->rcv_wnd_shift = TcpWindowShift(rcv_wnd);
+      entry->rcv_wnd_max = rcv_wnd;
+    } else {
+      // Without window scaling on both sides, neither side scales
+      entry->rcv_wnd_max = std::min(rcv_wnd, static_cast<uint32_t>(0xFFFF));
+    }
+    entry->rcv_wnd = entry->rcv_wnd_max;
+    entry->sack_ok = options.sack_permitted;
+    entry->ts_ok = options.timestamp_ok;
+    entry->ts_recent = options.tsval;
+    entry->rtt.timestamps = options.timestamp_ok;
+
+    // Create a SYN-ACK reply, only offering a window scale, SACK and
+    // timestamps if the remote side did
+    entry->EnqueueSyn(kTcpSyn | kTcpAck, options.window_scale_ok,
+                      options.sack_permitted, options.timestamp_ok);
 
     // Upcall application with new connection
     kassert(accept_fn);
@@ -490,13 +611,15 @@ bool TcpSeqGEQ(uint32_t first, uint32_t second) {
 // Send on a TCP connection
 void ebbrt::NetworkManager::TcpEntry::Send(std::unique_ptr<IOBuf> buf) {
   // Prepend a header to the chain which will Ack any received data
-  auto header_buf = MakeUniqueIOBuf(sizeof(TcpHeader) + sizeof(Ipv4Header) +
+  auto optlen = ts_ok ? kTcpTimestampOptLen : 0;
+  auto header_buf = MakeUniqueIOBuf(sizeof(TcpHeader) + optlen +
+                                    sizeof(Ipv4Header) +
                                     sizeof(EthernetHeader));
   header_buf->Advance(sizeof(Ipv4Header) + sizeof(EthernetHeader));
   header_buf->PrependChain(std::move(buf));
   auto dp = header_buf->GetMutDataPointer();
   auto& tcp_header = dp.Get<TcpHeader>();
-  EnqueueSegment(tcp_header, std::move(header_buf), kTcpAck);
+  EnqueueSegment(tcp_header, std::move(header_buf), kTcpAck, optlen);
 }
 
 size_t ebbrt::NetworkManager::TcpEntry::SendWindowRemaining() {
@@ -507,6 +630,16 @@ size_t ebbrt::NetworkManager::TcpEntry::SendWindowRemaining() {
 #endif
 }
 
+// Bytes sent but not yet acknowledged. Segments that were queued but not yet
+// sent (or moved back to the pending queue by a retransmit timeout) do not
+// count
+uint32_t ebbrt::NetworkManager::TcpEntry::FlightSize() {
+  if (unacked_segments.empty())
+    return 0;
+  auto& segment = unacked_segments.back();
+  return ntohl(segment.th.seqno) + segment.tcp_len - snd_una;
+}
+
 // Input on a TCP connection
 void ebbrt::NetworkManager::TcpEntry::Input(const Ipv4Header& ih, TcpHeader& th,
                                             TcpInfo& info,
@@ -575,7 +708,25 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
         // Received a SYN-ACK
         snd_una = info.ackno;
         state = kEstablished;
-        snd_wnd = ntohs(th.wnd) << kWindowShift;
+        auto options = ParseTcpOptions(th);
+        if (options.window_scale_ok) {
+          snd_wnd_shift = options.window_shift;
+        } else {
+          // The remote side does not scale, so we cannot either
+          rcv_wnd_shift = 0;
+          rcv_wnd_max = std::min(rcv_wnd_max, static_cast<uint32_t>(0xFFFF));
+          rcv_wnd = std::min(rcv_wnd, rcv_wnd_max);
+        }
+        sack_ok = options.sack_permitted;
+        // Complete the handshake without delay
+        ack_now = true;
+        ts_ok = options.timestamp_ok;
+        ts_recent = options.tsval;
+        rtt.timestamps = options.timestamp_ok;
+        RttAck(options, info.ackno, now);
+        // RFC 7323 2.2: The window field in a SYN segment itself is never
+        // scaled
+        snd_wnd = ntohs(th.wnd);
         snd_wl1 = info.seqno;
         snd_wl2 = info.ackno;
 
@@ -593,6 +744,16 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
   } else {
     auto flags = th.Flags();
 
+    TcpOptions options;
+    if ((sack_ok || ts_ok) && th.HdrLen() > sizeof(TcpHeader)) {
+      options = ParseTcpOptions(th);
+      // RFC 7323 4.3: Remember the timestamp to echo, only from segments that
+      // do not skip ahead of what we acknowledged last
+      if (options.timestamp_ok && TcpSeqLEQ(info.seqno, rcv_last_acked) &&
+          TcpSeqGEQ(options.tsval, ts_recent))
+        ts_recent = options.tsval;
+    }
+
     // XXX: I believe the spec says ACK processing must happen after validating
     // the sequence, but that can cause poor performance in some degenerative
     // cases so we do it here
@@ -614,7 +775,7 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
         }
 
         state = kEstablished;
-        snd_wnd = ntohs(th.wnd) << kWindowShift;
+        snd_wnd = ntohs(th.wnd) << snd_wnd_shift;
         snd_wl1 = info.seqno;
         snd_wl2 = info.ackno;
         // Fall through
@@ -624,6 +785,13 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
         // Common case: In a connected state
         if (TcpSeqBetween(info.ackno, snd_una, snd_nxt)) {
           // SND.UNA =< SEG.ACK =< SND.NEXT
+          auto acked = info.ackno - snd_una;
+          // RFC 5681 Page 4: a duplicate ACK acks nothing new, carries no
+          // data, does not change the window and arrives while data is
+          // outstanding
+          uint32_t wnd = ntohs(th.wnd) << snd_wnd_shift;
+          auto duplicate = acked == 0 && info.tcplen == 0 && wnd == snd_wnd &&
+                           !unacked_segments.empty();
           snd_una = info.ackno;
 
           if (TcpSeqBetween(info.ackno, snd_una + 1, snd_nxt) ||
@@ -636,12 +804,39 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
             // SEG.SEQ, and set SND.WL2 <- SEG.ACK."
             // ... "The check here prevents using old segments to update the
             // window"
-            snd_wnd = ntohs(th.wnd) << kWindowShift;
+            snd_wnd = wnd;
             snd_wl1 = info.seqno;
             snd_wl2 = info.ackno;
           }
 
           ClearAckedSegments(info);
+          if (options.sack_blocks)
+            ProcessSack(options);
+
+          if (acked > 0) {
+            RttAck(options, info.ackno, now);
+            // RFC 6298 5.3: Restart the timer when new data is acknowledged
+            if (!unacked_segments.empty())
+              retransmit = now + rtt.rto;
+            if (cc->OnAck(info.ackno, acked, now) &&
+                !unacked_segments.empty()) {
+              // A partial ACK during fast recovery, the segment following the
+              // acked data was lost as well. With SACK, resend the first hole
+              // instead, which may be further along
+              if (!sack_ok || !RetransmitHole())
+                Retransmit(unacked_segments.front());
+            }
+          } else if (duplicate) {
+            if (cc->OnDuplicateAck(snd_una, snd_una + FlightSize(),
+                                   FlightSize(), now)) {
+              // Fast retransmit of the segment the receiver is waiting for
+              Retransmit(unacked_segments.front());
+            } else if (sack_ok && cc->InRecovery()) {
+              // Each further duplicate lets a hole the receiver reported be
+              // filled
+              RetransmitHole();
+            }
+          }
 
           if (window_notify) {
             // Upcall user that the send window has increased
@@ -784,11 +979,15 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
             if (stashed_segments.count(info.seqno) == 0) {
               stashed_segments.emplace(info.seqno, std::move(buf));
             }
+            stash_recent = info.seqno;
             SendEmptyAck();
             return true;
           }
           // Append stashed in-sequence segments
           if (!stashed_segments.empty()) {
+            // RFC 5681 4.2: ACK at once when data fills a hole, so the sender
+            // learns of it quickly
+            ack_now = true;
             auto it = stashed_segments.begin();
             while (it != stashed_segments.end()) {
               if (it->first == rcv_nxt + payload_len) {
@@ -851,6 +1050,7 @@ bool ebbrt::NetworkManager::TcpEntry::Receive(
         }
 
         rcv_nxt = info.seqno + info.tcplen;
+        ack_now = true;
         if (state == kEstablished || state == kSynReceived) {
           state = kCloseWait;
           handler->Close();
@@ -910,9 +1110,14 @@ void ebbrt::NetworkManager::TcpEntry::ClearAckedSegments(const TcpInfo& info) {
   clear_acked_segments(pending_segments);
 
   if (unacked_segments.empty()) {
-    // The only timer that could be active here is our retransmit
-    // timer so we are safe to disable all timers
-    DisableTimers();
+    if (delayed_ack == ebbrt::clock::Wall::time_point()) {
+      // The only timer that could be active here is our retransmit
+      // timer so we are safe to disable all timers
+      DisableTimers();
+    } else {
+      // Keep the timer for the held ACK, it ignores the stale retransmit
+      retransmit = ebbrt::clock::Wall::time_point();
+    }
   }
 }
 
@@ -929,24 +1134,100 @@ void ebbrt::NetworkManager::TcpEntry::EnqueueSegment(
   th.SetHdrLenFlags(sizeof(TcpHeader) + optlen, flags);
   // ackno, wnd, and checksum are set in Output()
   th.urgp = 0;
+  if (optlen >= kTcpTimestampOptLen && !(flags & kTcpSyn)) {
+    // timestamp values are set in SendSegment()
+    auto opts = reinterpret_cast<uint8_t*>(th.options);
+    opts[0] = kTcpOptNop;
+    opts[1] = kTcpOptNop;
+    opts[2] = kTcpOptTimestamp;
+    opts[3] = 10;  // opt length
+  }
 
   pending_segments.emplace_back(std::move(buf), th, tcp_len);
 
   snd_nxt += tcp_len;
 }
 
+// Enqueue a SYN or SYN-ACK carrying our MSS and, if requested, our timestamps,
+// window scale and SACK permitted options
+void ebbrt::NetworkManager::TcpEntry::EnqueueSyn(uint16_t flags,
+                                                 bool window_scale,
+                                                 bool sack_permitted,
+                                                 bool timestamps) {
+  // (NOP + NOP + TS) + MSS (+ NOP + NOP + SACK permitted) (+ NOP + WS)
+  auto optlen = (timestamps ? kTcpTimestampOptLen : 0) + 4 +
+                (sack_permitted ? 4 : 0) + (window_scale ? 4 : 0);
+  auto buf = MakeUniqueIOBuf(optlen + sizeof(TcpHeader) + sizeof(Ipv4Header) +
+                             sizeof(EthernetHeader));
+  buf->Advance(sizeof(Ipv4Header) + sizeof(EthernetHeader));
+  auto dp = buf->GetMutDataPointer();
+  auto& tcp_header = dp.Get<TcpHeader>();
+  auto opts = reinterpret_cast<uint8_t*>(tcp_header.options);
+  if (timestamps) {
+    // The timestamps go first, where SendSegment() expects them
+    opts[0] = kTcpOptNop;
+    opts[1] = kTcpOptNop;
+    opts[2] = kTcpOptTimestamp;
+    opts[3] = 10;  // opt length
+    opts += kTcpTimestampOptLen;
+  }
+  opts[0] = kTcpOptMss;
+  opts[1] = 4;  // opt length
+  opts[2] = kTcpMss >> 8;
+  opts[3] = kTcpMss & 0xFF;
+  opts += 4;
+  if (sack_permitted) {
+    opts[0] = kTcpOptNop;
+    opts[1] = kTcpOptNop;
+    opts[2] = kTcpOptSackPermitted;
+    opts[3] = 2;  // opt length
+    opts += 4;
+  }
+  if (window_scale) {
+    opts[0] = kTcpOptNop;
+    opts[1] = kTcpOptWindowScale;
+    opts[2] = 3;  // opt length
+    opts[3] = rcv_wnd_shift;
+  }
+  EnqueueSegment(tcp_header, std::move(buf), flags, optlen);
+}
+
 // Attempt to send any outstanding tcp segments
 size_t
 ebbrt::NetworkManager::TcpEntry::Output(ebbrt::clock::Wall::time_point now) {
   auto it = pending_segments.begin();
 
-  // try to send as many pending segments as will fit in the window
+  // try to send as many pending segments as will fit in both the receiver's
+  // window and the congestion window. The congestion window does not hold back
+  // the first segment when nothing is in flight, as a segment may be larger
+  // than the window
   size_t sent = 0;
+  auto cwnd_limit = snd_una + cc->cwnd();
   for (; it != pending_segments.end() &&
          TcpSeqLEQ(ntohl(it->th.seqno) + it->tcp_len,
-                   snd_nxt + SendWindowRemaining());
+                   snd_nxt + SendWindowRemaining()) &&
+         (TcpSeqLEQ(ntohl(it->th.seqno) + it->tcp_len, cwnd_limit) ||
+          (sent == 0 && unacked_segments.empty()));
        ++it) {
-    SendSegment(*it);
+    it->retransmitted = false;
+    if (unlikely(it->sacked)) {
+      // Moved back by a retransmit timeout but the receiver already has it.
+      // The receiver may still discard SACKed data (RFC 2018 8), so the
+      // segment is only skipped once
+      it->sacked = false;
+    } else {
+      SendSegment(*it);
+      auto end = ntohl(it->th.seqno) + it->tcp_len;
+      if (TcpSeqGT(end, snd_max)) {
+        // New data, time it if we are not timing a segment already
+        if (!ts_ok && !rtt_timing) {
+          rtt_timing = true;
+          rtt_seq = end;
+          rtt_start = now;
+        }
+        snd_max = end;
+      }
+    }
     ++sent;
   }
 
@@ -968,22 +1249,40 @@ ebbrt::NetworkManager::TcpEntry::Output(ebbrt::clock::Wall::time_point now) {
     }
 
     // In the case that we don't have any data to send out but we have received
-    // data since our last ACK, we will send an empty ACK
+    // data since our last ACK, we will send an empty ACK. Unless an ACK is due
+    // now, we only do so for every second full-size segment and otherwise
+    // leave it to the delayed ACK timer, giving data queued in the meantime
+    // the chance to carry it (RFC 1122 4.2.3.2)
     if (TcpSeqLT(rcv_last_acked, rcv_nxt)) {
-      SendEmptyAck();
+      auto full_size = kTcpMss - (ts_ok ? kTcpTimestampOptLen : 0);
+      if (ack_now || quick_ack || rcv_nxt - rcv_last_acked >= 2 * full_size) {
+        SendEmptyAck();
+      } else if (delayed_ack == ebbrt::clock::Wall::time_point()) {
+        delayed_ack = now + kTcpDelayedAck;
+      }
     }
   }
 
-  if (sent) {
-    retransmit = now + std::chrono::milliseconds(250);
+  // RFC 6298 5.1: Start the timer if it is not running
+  if (sent && retransmit == ebbrt::clock::Wall::time_point()) {
+    retransmit = now + rtt.rto;
   }
 
   return sent;
 }
 
-// Send an Ack with no data
+// Send an Ack with no data, describing any out of order data we hold with
+// SACK blocks
 void ebbrt::NetworkManager::TcpEntry::SendEmptyAck() {
-  auto buf = MakeUniqueIOBuf(sizeof(TcpHeader) + sizeof(Ipv4Header) +
+  TcpSackBlock blocks[kTcpMaxSackBlocks];
+  size_t nblocks = 0;
+  // The timestamps take the room of one block
+  if (sack_ok && !stashed_segments.empty())
+    nblocks = SackBlocks(blocks, kTcpMaxSackBlocks - (ts_ok ? 1 : 0));
+  auto tslen = ts_ok ? kTcpTimestampOptLen : 0;
+  auto optlen = tslen + (nblocks ? 4 + 8 * nblocks : 0);  // NOP + NOP + SACK
+
+  auto buf = MakeUniqueIOBuf(sizeof(TcpHeader) + optlen + sizeof(Ipv4Header) +
                              sizeof(EthernetHeader));
   buf->Advance(sizeof(Ipv4Header) + sizeof(EthernetHeader));
   auto dp = buf->GetMutDataPointer();
@@ -991,11 +1290,34 @@ void ebbrt::NetworkManager::TcpEntry::SendEmptyAck() {
   th.src_port = htons(std::get<2>(key));
   th.dst_port = htons(std::get<1>(key));
   th.seqno = htonl(snd_nxt);
-  th.SetHdrLenFlags(sizeof(TcpHeader), kTcpAck);
+  th.SetHdrLenFlags(sizeof(TcpHeader) + optlen, kTcpAck);
+  if (ts_ok) {
+    auto opts = reinterpret_cast<uint8_t*>(th.options);
+    opts[0] = kTcpOptNop;
+    opts[1] = kTcpOptNop;
+    opts[2] = kTcpOptTimestamp;
+    opts[3] = 10;  // opt length
+    SetTimestamps(th, ebbrt::clock::Wall::Now());
+  }
+  if (nblocks) {
+    auto opts = reinterpret_cast<uint8_t*>(th.options) + tslen;
+    opts[0] = kTcpOptNop;
+    opts[1] = kTcpOptNop;
+    opts[2] = kTcpOptSack;
+    opts[3] = 2 + 8 * nblocks;  // opt length
+    auto edges = reinterpret_cast<uint32_t*>(opts + 4);
+    for (size_t i = 0; i < nblocks; ++i) {
+      edges[2 * i] = htonl(blocks[i].begin);
+      edges[2 * i + 1] = htonl(blocks[i].end);
+    }
+  }
   th.urgp = 0;
   rcv_last_acked = rcv_nxt;
+  // Any held ACK goes out with this segment
+  ack_now = false;
+  delayed_ack = ebbrt::clock::Wall::time_point();
   th.ackno = htonl(rcv_nxt);
-  th.wnd = htons(TcpWindow16(rcv_wnd));
+  th.wnd = htons(TcpWindow16(rcv_wnd, rcv_wnd_shift));
   th.checksum = OffloadPseudoCsum(*buf, kIpProtoTCP, address, std::get<0>(key));
 
   PacketInfo pinfo;
@@ -1007,6 +1329,141 @@ void ebbrt::NetworkManager::TcpEntry::SendEmptyAck() {
                           kIpProtoTCP, pinfo);
 }
 
+// Describe the out of order data in stashed_segments as at most max blocks,
+// the one holding the most recently received segment first (RFC 2018 4).
+// Returns the number of blocks
+size_t ebbrt::NetworkManager::TcpEntry::SackBlocks(TcpSackBlock* blocks,
+                                                   size_t max) {
+  size_t n = 1;
+  bool recent_found = false;
+  auto add = [&](uint32_t begin, uint32_t end) {
+    if (!recent_found && TcpSeqGEQ(stash_recent, begin) &&
+        TcpSeqLT(stash_recent, end)) {
+      blocks[0] = {begin, end};
+      recent_found = true;
+    } else if (n < max) {
+      blocks[n++] = {begin, end};
+    }
+  };
+
+  // Merge stashed segments into contiguous ranges
+  auto it = stashed_segments.begin();
+  auto begin = it->first;
+  auto end = begin + it->second->ComputeChainDataLength();
+  for (++it; it != stashed_segments.end(); ++it) {
+    auto seg_end = it->first + it->second->ComputeChainDataLength();
+    if (TcpSeqLEQ(it->first, end)) {
+      if (TcpSeqGT(seg_end, end))
+        end = seg_end;
+    } else {
+      add(begin, end);
+      begin = it->first;
+      end = seg_end;
+    }
+  }
+  add(begin, end);
+
+  if (!recent_found) {
+    std::copy(blocks + 1, blocks + n, blocks);
+    --n;
+  }
+  return n;
+}
+
+// Update the scoreboard: mark the unacked segments covered by the SACK blocks
+// of an incoming ACK
+void ebbrt::NetworkManager::TcpEntry::ProcessSack(const TcpOptions& options) {
+  for (size_t i = 0; i < options.sack_blocks; ++i) {
+    auto& block = options.sack[i];
+    // Ignore blocks for data already acked (D-SACK) or never sent
+    if (TcpSeqLEQ(block.begin, snd_una) || TcpSeqGT(block.end, snd_nxt) ||
+        TcpSeqGEQ(block.begin, block.end))
+      continue;
+    for (auto& segment : unacked_segments) {
+      auto seq = ntohl(segment.th.seqno);
+      if (TcpSeqGEQ(seq, block.end))
+        break;
+      if (TcpSeqGEQ(seq, block.begin) &&
+          TcpSeqLEQ(seq + segment.tcp_len, block.end))
+        segment.sacked = true;
+    }
+    if (TcpSeqGT(block.end, sack_high))
+      sack_high = block.end;
+  }
+}
+
+// Retransmit the first segment that was not SACKed, lies below the highest
+// SACKed sequence number (so it is presumed lost) and was not already resent
+// in this recovery. Returns false if there is no such segment
+bool ebbrt::NetworkManager::TcpEntry::RetransmitHole() {
+  for (auto& segment : unacked_segments) {
+    if (TcpSeqGEQ(ntohl(segment.th.seqno), sack_high))
+      break;
+    if (segment.sacked || segment.retransmitted)
+      continue;
+    Retransmit(segment);
+    return true;
+  }
+  return false;
+}
+
+// Resend an unacked segment, which can then no longer be timed (Karn's
+// algorithm)
+void ebbrt::NetworkManager::TcpEntry::Retransmit(TcpSegment& segment) {
+  segment.retransmitted = true;
+  rtt_timing = false;
+  SendSegment(segment);
+}
+
+// Take a round trip time sample from an ACK of new data, from the echoed
+// timestamp if timestamps are in use, otherwise if it ends the timing of a
+// segment
+void ebbrt::NetworkManager::TcpEntry::RttAck(
+    const TcpOptions& options, uint32_t ackno,
+    ebbrt::clock::Wall::time_point now) {
+  if (ts_ok) {
+    if (!options.timestamp_ok || options.tsecr == 0)
+      return;
+    auto elapsed = static_cast<int32_t>(TcpTimestamp(now) - options.tsecr);
+    if (elapsed >= 0)
+      RttSample(std::chrono::milliseconds(elapsed));
+  } else if (rtt_timing && TcpSeqGEQ(ackno, rtt_seq)) {
+    rtt_timing = false;
+    RttSample(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - rtt_start));
+  }
+}
+
+// RFC 6298 2.2 and 2.3
+void ebbrt::NetworkManager::TcpEntry::RttSample(std::chrono::microseconds r) {
+  if (rtt.samples == 0) {
+    rtt.srtt = r;
+    rtt.rttvar = r / 2;
+    rtt.min_rtt = r;
+  } else {
+    auto delta = rtt.srtt > r ? rtt.srtt - r : r - rtt.srtt;
+    rtt.rttvar = (3 * rtt.rttvar + delta) / 4;
+    rtt.srtt = (7 * rtt.srtt + r) / 8;
+    rtt.min_rtt = std::min(rtt.min_rtt, r);
+  }
+  ++rtt.samples;
+  // This also clears any backoff (RFC 6298 5.7)
+  rtt.rto = std::min(std::max(rtt.srtt + 4 * rtt.rttvar, kTcpMinRto),
+                     kTcpMaxRto);
+}
+
+// Fill in the timestamps of a header that carries them first in its options
+void ebbrt::NetworkManager::TcpEntry::SetTimestamps(
+    TcpHeader& th, ebbrt::clock::Wall::time_point now) {
+  auto opts = reinterpret_cast<uint8_t*>(th.options);
+  if (th.HdrLen() < sizeof(TcpHeader) + kTcpTimestampOptLen ||
+      opts[2] != kTcpOptTimestamp)
+    return;
+  auto values = reinterpret_cast<uint32_t*>(opts + 4);
+  values[0] = htonl(TcpTimestamp(now));
+  values[1] = htonl(ts_recent);
+}
+
 // When Close() is called we will send a FIN and wait for all outstanding
 // segments to be acked before deleting the entry
 void ebbrt::NetworkManager::TcpEntry::Close() {
@@ -1045,19 +1502,26 @@ void ebbrt::NetworkManager::TcpEntry::SendFin() {
   }
 
   // Otherwise create an empty segment with a Fin
-  auto buf = MakeUniqueIOBuf(sizeof(TcpHeader) + sizeof(Ipv4Header) +
+  auto optlen = ts_ok ? kTcpTimestampOptLen : 0;
+  auto buf = MakeUniqueIOBuf(sizeof(TcpHeader) + optlen + sizeof(Ipv4Header) +
                              sizeof(EthernetHeader));
   buf->Advance(sizeof(Ipv4Header) + sizeof(EthernetHeader));
   auto dp = buf->GetMutDataPointer();
   auto& tcp_header = dp.Get<TcpHeader>();
-  EnqueueSegment(tcp_header, std::move(buf), kTcpFin | kTcpAck);
+  EnqueueSegment(tcp_header, std::move(buf), kTcpFin | kTcpAck, optlen);
 }
 
 // Actually send a segment via IP
 void ebbrt::NetworkManager::TcpEntry::SendSegment(TcpSegment& segment) {
   rcv_last_acked = rcv_nxt;
+  // Any held ACK goes out with this segment
+  ack_now = false;
+  delayed_ack = ebbrt::clock::Wall::time_point();
   segment.th.ackno = htonl(rcv_nxt);
-  segment.th.wnd = htons(TcpWindow16(rcv_wnd));
+  // RFC 7323 2.2: The window field in a SYN segment itself is never scaled
+  auto shift = (segment.th.Flags() & kTcpSyn) ? 0 : rcv_wnd_shift;
+  segment.th.wnd = htons(TcpWindow16(rcv_wnd, shift));
+  SetTimestamps(segment.th, ebbrt::clock::Wall::Now());
   segment.th.checksum = 0;
   // XXX: check if checksum offloading is supported
   segment.th.checksum =
@@ -1068,7 +1532,8 @@ void ebbrt::NetworkManager::TcpEntry::SendSegment(TcpSegment& segment) {
   pinfo.csum_offset = 16;  // checksum is 16 bytes into the TCP header
 
   // XXX: Actually store the MSS instead of making this assumption
-  size_t mss = 1460;
+  // Options take room from the payload of each packet
+  size_t mss = kTcpMss - (segment.th.HdrLen() - sizeof(TcpHeader));
   if (segment.tcp_len > mss) {
     pinfo.gso_type = PacketInfo::kGsoTcpv4;
     pinfo.hdr_len = segment.th.HdrLen();
@@ -1098,7 +1563,7 @@ void ebbrt::NetworkManager::TcpReset(bool ack, uint32_t seqno, uint32_t ackno,
   tcp_header.seqno = htonl(seqno);
   tcp_header.ackno = htonl(ackno);
   tcp_header.SetHdrLenFlags(sizeof(TcpHeader), kTcpRst | (ack ? kTcpAck : 0));
-  tcp_header.wnd = htons(TcpWindow16(kTcpWnd));
+  tcp_header.wnd = htons(TcpWindow16(kTcpWnd, TcpWindowShift(kTcpWnd)));
   tcp_header.urgp = 0;
   tcp_header.checksum =
       OffloadPseudoCsum(*buf, kIpProtoTCP, local_ip, remote_ip);
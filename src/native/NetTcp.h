@@ -5,13 +5,24 @@
 #ifndef BAREMETAL_SRC_INCLUDE_EBBRT_NETTCP_H_
 #define BAREMETAL_SRC_INCLUDE_EBBRT_NETTCP_H_
 
+#include <chrono>
+
 namespace ebbrt {
 const constexpr size_t kTcpMss = 1460;
+// default receive window of a connection
 const constexpr uint32_t kTcpWnd = 1 << 21;
-const constexpr uint8_t kWindowShift = 7;
+// RFC 7323 limits the window shift to 14, for windows of up to 1GB
+const constexpr uint8_t kTcpMaxWindowShift = 14;
+const constexpr uint32_t kTcpMaxWnd = 0xFFFF << kTcpMaxWindowShift;
+
+// The 16 bit window field advertising sz with the given shift
+const constexpr uint16_t TcpWindow16(uint32_t sz, uint8_t shift) {
+  return (sz >> shift) > 0xFFFF ? 0xFFFF : (sz >> shift);
+}
 
-const constexpr uint16_t TcpWindow16(uint32_t sz) {
-  return sz >> kWindowShift; 
+// The smallest shift that can advertise a window of sz
+const constexpr uint8_t TcpWindowShift(uint32_t sz) {
+  return (sz >> 16) == 0 ? 0 : 1 + TcpWindowShift(sz >> 1);
 }
 
 const constexpr uint16_t kTcpFin = 0x01;
@@ -25,6 +36,39 @@ const constexpr uint16_t kTcpCwr = 0x80;
 
 const constexpr uint16_t kTcpFlagMask = 0x3f;
 
+const constexpr uint8_t kTcpOptEnd = 0;
+const constexpr uint8_t kTcpOptNop = 1;
+const constexpr uint8_t kTcpOptMss = 2;
+const constexpr uint8_t kTcpOptWindowScale = 3;
+const constexpr uint8_t kTcpOptSackPermitted = 4;
+const constexpr uint8_t kTcpOptSack = 5;
+const constexpr uint8_t kTcpOptTimestamp = 8;
+
+// as many SACK blocks as fit in the 40 bytes of option space
+const constexpr size_t kTcpMaxSackBlocks = 4;
+// NOP + NOP + timestamps, placed first in the options of every segment once
+// timestamps are in use
+const constexpr size_t kTcpTimestampOptLen = 12;
+
+// RFC 6298 2.1 initial retransmission timeout
+const constexpr std::chrono::microseconds kTcpInitialRto =
+    std::chrono::seconds(1);
+// RFC 6298 2.4 asks for a minimum of one second, far above the round trip
+// times of a LAN. Like other stacks we use a lower bound of 200ms
+const constexpr std::chrono::microseconds kTcpMinRto =
+    std::chrono::milliseconds(200);
+const constexpr std::chrono::microseconds kTcpMaxRto = std::chrono::seconds(60);
+// longest an ACK is held back hoping to piggyback it (RFC 1122 4.2.3.2 allows
+// up to 500ms)
+const constexpr std::chrono::microseconds kTcpDelayedAck =
+    std::chrono::milliseconds(40);
+
+// A range [begin, end) of sequence numbers received out of order
+struct TcpSackBlock {
+  uint32_t begin;
+  uint32_t end;
+};
+
 struct __attribute__((packed)) TcpHeader {
   void SetHdrLenFlags(size_t header_len, uint16_t flags) {
     auto header_words = header_len / 4;
@@ -50,6 +94,32 @@ struct __attribute__((packed)) TcpHeader {
   char options[];
 };
 
+// Options carried by a segment. All but the SACK blocks are only meaningful on
+// a SYN
+struct TcpOptions {
+  bool mss_ok{false};
+  uint16_t mss{0};
+  bool window_scale_ok{false};
+  uint8_t window_shift{0};
+  bool sack_permitted{false};
+  size_t sack_blocks{0};
+  TcpSackBlock sack[kTcpMaxSackBlocks];
+  bool timestamp_ok{false};
+  uint32_t tsval{0};
+  uint32_t tsecr{0};
+};
+
+// Round trip time estimation of a connection (RFC 6298)
+struct TcpRttStats {
+  std::chrono::microseconds srtt{0};  // smoothed round trip time
+  std::chrono::microseconds rttvar{0};  // round trip time variation
+  std::chrono::microseconds min_rtt{0};
+  std::chrono::microseconds rto{kTcpInitialRto};  // retransmission timeout
+  uint64_t samples{0};
+  uint64_t timeouts{0};  // retransmission timeouts that fired
+  bool timestamps{false};  // samples come from the timestamps option
+};
+
 struct TcpInfo {
   uint16_t src_port;
   uint16_t dst_port;
@@ -0,0 +1,176 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "NetTcpCongestion.h"
+
+#include <algorithm>
+
+namespace {
+// windows never grow beyond what the largest scaled window could advertise
+const constexpr uint32_t kMaxWindow = 1 << 30;
+// RFC 8312 constants
+const constexpr double kCubicC = 0.4;
+const constexpr double kCubicBeta = 0.7;
+
+bool SeqLT(uint32_t first, uint32_t second) {
+  return static_cast<int32_t>(first - second) < 0;
+}
+
+bool SeqGEQ(uint32_t first, uint32_t second) {
+  return static_cast<int32_t>(first - second) >= 0;
+}
+
+// Newton's method, we have no libm
+double Cbrt(double x) {
+  if (x <= 0)
+    return 0;
+  auto y = x < 1 ? 1.0 : x / 3;
+  for (int i = 0; i < 100; ++i) {
+    auto next = (2 * y + x / (y * y)) / 3;
+    if (next >= y * 0.999999 && next <= y * 1.000001)
+      return next;
+    y = next;
+  }
+  return y;
+}
+}  // namespace
+
+// RFC 6928 initial window
+ebbrt::TcpCongestionControl::TcpCongestionControl(uint32_t mss)
+    : mss_(mss), cwnd_(std::min(10 * mss, std::max(2 * mss, 14600u))),
+      ssthresh_(kMaxWindow) {}
+
+void ebbrt::TcpCongestionControl::AddToWindow(uint32_t bytes) {
+  cwnd_ = std::min(cwnd_ + std::min(bytes, kMaxWindow), kMaxWindow);
+}
+
+bool ebbrt::TcpCongestionControl::OnAck(uint32_t ackno, uint32_t acked,
+                                        clock::Wall::time_point now) {
+  dupacks_ = 0;
+  if (recover_valid_ && SeqGEQ(ackno, recover_))
+    recover_valid_ = false;
+
+  if (in_recovery_) {
+    if (!recover_valid_) {
+      // Full acknowledgement, deflate the window
+      in_recovery_ = false;
+      cwnd_ = ssthresh_;
+      return false;
+    }
+    // Partial acknowledgement: the next hole is lost too. Deflate the window
+    // by the amount acked and add back one segment for the retransmission
+    cwnd_ = cwnd_ > acked ? cwnd_ - acked : 0;
+    if (acked >= mss_)
+      cwnd_ += mss_;
+    cwnd_ = std::max(cwnd_, mss_);
+    return true;
+  }
+
+  if (cwnd_ < ssthresh_) {
+    // Slow start, with byte counting limited to two segments per ACK (RFC
+    // 3465)
+    AddToWindow(std::min(acked, 2 * mss_));
+  } else {
+    IncreaseWindow(acked, now);
+  }
+  return false;
+}
+
+bool ebbrt::TcpCongestionControl::OnDuplicateAck(uint32_t snd_una,
+                                                 uint32_t snd_nxt,
+                                                 uint32_t flight,
+                                                 clock::Wall::time_point now) {
+  if (in_recovery_) {
+    // Each duplicate means a segment has left the network
+    AddToWindow(mss_);
+    return false;
+  }
+
+  if (++dupacks_ != 3)
+    return false;
+
+  // Don't react twice to losses from the same window
+  if (recover_valid_ && SeqLT(snd_una, recover_))
+    return false;
+
+  ssthresh_ = OnLoss(flight, now);
+  cwnd_ = ssthresh_ + 3 * mss_;
+  recover_ = snd_nxt;
+  recover_valid_ = true;
+  in_recovery_ = true;
+  return true;
+}
+
+void ebbrt::TcpCongestionControl::OnRetransmitTimeout(
+    uint32_t snd_nxt, uint32_t flight, clock::Wall::time_point now) {
+  ssthresh_ = OnLoss(flight, now);
+  // RFC 5681 loss window
+  cwnd_ = mss_;
+  dupacks_ = 0;
+  recover_ = snd_nxt;
+  recover_valid_ = true;
+  in_recovery_ = false;
+}
+
+void ebbrt::TcpNewReno::IncreaseWindow(uint32_t acked,
+                                       clock::Wall::time_point now) {
+  bytes_acked_ += acked;
+  if (bytes_acked_ >= cwnd_) {
+    bytes_acked_ -= cwnd_;
+    AddToWindow(mss_);
+  }
+}
+
+uint32_t ebbrt::TcpNewReno::OnLoss(uint32_t flight,
+                                   clock::Wall::time_point now) {
+  bytes_acked_ = 0;
+  return std::max(flight / 2, 2 * mss_);
+}
+
+void ebbrt::TcpCubic::IncreaseWindow(uint32_t acked,
+                                     clock::Wall::time_point now) {
+  auto cwnd = static_cast<double>(cwnd_) / mss_;
+  if (epoch_start_ == clock::Wall::time_point()) {
+    // First increase since the last loss
+    epoch_start_ = now;
+    if (cwnd < w_max_) {
+      k_ = Cbrt((w_max_ - cwnd) / kCubicC);
+    } else {
+      k_ = 0;
+      w_max_ = cwnd;
+    }
+    w_est_ = cwnd;
+  }
+
+  auto t = std::chrono::duration_cast<std::chrono::duration<double>>(
+               now - epoch_start_)
+               .count() -
+           k_;
+  auto target = w_max_ + kCubicC * t * t * t;
+
+  // TCP friendly region: grow at least as fast as standard TCP would
+  auto segments_acked = static_cast<double>(acked) / mss_;
+  w_est_ += 3 * (1 - kCubicBeta) / (1 + kCubicBeta) * segments_acked / cwnd;
+  target = std::max(target, w_est_);
+
+  // Never grow more than half a window per window acked
+  target = std::min(target, 1.5 * cwnd);
+  if (target > cwnd)
+    AddToWindow(static_cast<uint32_t>((target - cwnd) / cwnd * acked));
+}
+
+uint32_t ebbrt::TcpCubic::OnLoss(uint32_t flight,
+                                 clock::Wall::time_point now) {
+  epoch_start_ = clock::Wall::time_point();
+  auto cwnd = static_cast<double>(cwnd_) / mss_;
+  if (cwnd < w_last_max_) {
+    // Fast convergence: release bandwidth to newer flows
+    w_last_max_ = cwnd;
+    w_max_ = cwnd * (1 + kCubicBeta) / 2;
+  } else {
+    w_last_max_ = cwnd;
+    w_max_ = cwnd;
+  }
+  return std::max(static_cast<uint32_t>(flight * kCubicBeta), 2 * mss_);
+}
@@ -0,0 +1,98 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BAREMETAL_SRC_INCLUDE_EBBRT_NETTCPCONGESTION_H_
+#define BAREMETAL_SRC_INCLUDE_EBBRT_NETTCPCONGESTION_H_
+
+#include <cstdint>
+
+#include "Clock.h"
+
+namespace ebbrt {
+// Congestion window of a TCP connection. The base class implements slow start
+// (RFC 5681), fast retransmit and NewReno fast recovery (RFC 6582), the
+// algorithms decide how the window grows in congestion avoidance and how far
+// it is cut when a loss is detected.
+//
+// All sequence numbers and byte counts passed in are those of the connection,
+// flight is the number of bytes sent but not yet acknowledged.
+class TcpCongestionControl {
+ public:
+  explicit TcpCongestionControl(uint32_t mss);
+  virtual ~TcpCongestionControl() {}
+
+  uint32_t cwnd() const { return cwnd_; }
+  uint32_t ssthresh() const { return ssthresh_; }
+  bool InRecovery() const { return in_recovery_; }
+
+  // An ACK advanced snd_una by acked bytes up to ackno. Returns true if the
+  // segment now at snd_una should be retransmitted (a partial ACK during
+  // recovery)
+  bool OnAck(uint32_t ackno, uint32_t acked, clock::Wall::time_point now);
+  // A duplicate ACK for snd_una arrived. Returns true if the segment at
+  // snd_una should be retransmitted (the third duplicate)
+  bool OnDuplicateAck(uint32_t snd_una, uint32_t snd_nxt, uint32_t flight,
+                      clock::Wall::time_point now);
+  // The retransmit timer expired, everything in flight will be resent
+  void OnRetransmitTimeout(uint32_t snd_nxt, uint32_t flight,
+                           clock::Wall::time_point now);
+
+ protected:
+  // Grow the window in congestion avoidance (cwnd_ >= ssthresh_)
+  virtual void IncreaseWindow(uint32_t acked, clock::Wall::time_point now) = 0;
+  // A loss was detected with flight bytes outstanding, return the new
+  // ssthresh. The window is set from it by the caller
+  virtual uint32_t OnLoss(uint32_t flight, clock::Wall::time_point now) = 0;
+
+  void AddToWindow(uint32_t bytes);
+
+  uint32_t mss_;
+  uint32_t cwnd_;
+  uint32_t ssthresh_;
+
+ private:
+  uint32_t dupacks_{0};
+  // highest sequence number sent when the last loss was detected, fast
+  // retransmit is not entered again until it is acknowledged
+  uint32_t recover_{0};
+  bool recover_valid_{false};
+  bool in_recovery_{false};
+};
+
+// RFC 5681 congestion avoidance: grow by one segment per window acked
+class TcpNewReno : public TcpCongestionControl {
+ public:
+  explicit TcpNewReno(uint32_t mss) : TcpCongestionControl(mss) {}
+
+ protected:
+  void IncreaseWindow(uint32_t acked, clock::Wall::time_point now) override;
+  uint32_t OnLoss(uint32_t flight, clock::Wall::time_point now) override;
+
+ private:
+  uint32_t bytes_acked_{0};
+};
+
+// RFC 8312 CUBIC: the window grows as a cubic function of the time since the
+// last loss, centered on the window at which that loss happened
+class TcpCubic : public TcpCongestionControl {
+ public:
+  explicit TcpCubic(uint32_t mss) : TcpCongestionControl(mss) {}
+
+ protected:
+  void IncreaseWindow(uint32_t acked, clock::Wall::time_point now) override;
+  uint32_t OnLoss(uint32_t flight, clock::Wall::time_point now) override;
+
+ private:
+  // windows are kept in segments
+  double w_max_{0};
+  double w_last_max_{0};
+  // window of standard TCP over the same period, CUBIC never does worse
+  double w_est_{0};
+  // time to grow back to w_max_, in seconds
+  double k_{0};
+  clock::Wall::time_point epoch_start_;
+};
+}  // namespace ebbrt
+
+#endif  // BAREMETAL_SRC_INCLUDE_EBBRT_NETTCPCONGESTION_H_
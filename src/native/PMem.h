@@ -12,6 +12,9 @@ const constexpr size_t kPageSize = 1 << kPageShift;
 
 const constexpr size_t kLargePageShift = 21;
 const constexpr size_t kLargePageSize = 1 << kLargePageShift;
+
+const constexpr size_t kHugePageShift = 30;
+const constexpr size_t kHugePageSize = 1 << kHugePageShift;
 }
 }
 
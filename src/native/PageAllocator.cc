@@ -4,6 +4,7 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 #include "PageAllocator.h"
 
+#include <cstring>
 #include <mutex>
 
 #include <boost/container/static_vector.hpp>
@@ -12,13 +13,50 @@
 #include "Cpu.h"
 #include "Debug.h"
 #include "EarlyPageAllocator.h"
+#include "EventManager.h"
 #include "MemMap.h"
 
 ebbrt::ExplicitlyConstructed<boost::container::static_vector<
     ebbrt::PageAllocator, ebbrt::numa::kMaxNodes>>
     ebbrt::PageAllocator::allocators;
 
+ebbrt::ExplicitlyConstructed<
+    std::array<ebbrt::PageAllocator::CpuCache, ebbrt::Cpu::kMaxCpus>>
+    ebbrt::PageAllocator::cpu_caches_;
+
+namespace {
+struct ShrinkerRegistry {
+  ebbrt::SpinLock lock;
+  boost::intrusive::list<ebbrt::PageAllocator::Shrinker> list;
+  // read without the lock as the shrinkers themselves allocate
+  std::atomic<bool> enabled{false};
+};
+
+ebbrt::ExplicitlyConstructed<ShrinkerRegistry> shrinkers;
+
+// each core refills its node's zeroed page pool from its own idle callback.
+// They are built up front as they are started from the allocation path, which
+// may be reached from a fault taken inside malloc.
+std::atomic<bool> zeroing_enabled{false};
+
+std::atomic<bool> large_cache_enabled{false};
+ebbrt::ExplicitlyConstructed<
+    std::array<ebbrt::ExplicitlyConstructed<ebbrt::EventManager::IdleCallback>,
+               ebbrt::Cpu::kMaxCpus>>
+    zero_callbacks;
+}
+
 void ebbrt::PageAllocator::Init() {
+  shrinkers.construct();
+  zero_callbacks.construct();
+  for (auto& callback : *zero_callbacks) {
+    callback.construct([]() {
+      auto& allocator = (*allocators)[Cpu::GetMyNode().val()];
+      if (!allocator.ZeroPage())
+        (*zero_callbacks)[Cpu::GetMine()]->Stop();
+    });
+  }
+  cpu_caches_.construct();
   allocators.construct();
   for (unsigned i = 0; i < numa::nodes->size(); ++i) {
     allocators->emplace_back(Nid(i));
@@ -55,12 +93,17 @@ void ebbrt::PageAllocator::Init() {
     kassert((*allocators)[i].Validate());
   }
 #endif
+  for (auto& allocator : *allocators) {
+    allocator.low_watermark_ = allocator.free_pages_ >> kDefaultWatermarkShift;
+  }
 }
 
 void ebbrt::PageAllocator::EarlyFreePage(Pfn start, size_t order, Nid nid) {
   kassert(order <= kMaxOrder);
   auto entry = PfnToFreePage(start);
-  (*allocators)[nid.val()].free_page_lists[order].push_front(*entry);
+  auto& allocator = (*allocators)[nid.val()];
+  allocator.free_page_lists[order].push_front(*entry);
+  allocator.free_pages_ += 1 << order;
   auto page = mem_map::PfnToPage(start);
   kassert(page != nullptr);
   page->usage = mem_map::Page::Usage::kPageAllocator;
@@ -76,16 +119,39 @@ ebbrt::PageAllocator& ebbrt::PageAllocator::HandleFault(EbbId id) {
 
 ebbrt::PageAllocator::PageAllocator(Nid nid) : nid_(nid) {}
 
-ebbrt::Pfn ebbrt::PageAllocator::AllocLocal(size_t order, uint64_t max_addr) {
-
-  // cause a stack allocator page fault first, to
-  // avoid deadlocking when calling malloc and
-  // stack faulting at the same time
+namespace {
+// cause a stack allocator page fault first, to avoid deadlocking when calling
+// malloc and stack faulting at the same time (or, for the per core caches,
+// reentering them from the fault handler)
+__attribute__((always_inline)) inline void TouchStack() {
   int tmp;
   asm volatile("movl -1024(%%rsp), %0;" : "=r"(tmp) : :);
+}
+}
 
-  std::lock_guard<SpinLock> lock(lock_);
+ebbrt::Pfn ebbrt::PageAllocator::AllocLocal(size_t order, uint64_t max_addr) {
+  TouchStack();
+
+  std::unique_lock<SpinLock> lock(lock_);
+  auto pfn = AllocLocked(order, max_addr);
+  if (unlikely(pfn == Pfn::None())) {
+    // the pages needed may be sitting in the per core caches, or coalesce
+    // into a block of this order once returned
+    lock.unlock();
+    DrainCpuCaches();
+    lock.lock();
+    pfn = AllocLocked(order, max_addr);
+  }
+  auto pressure = pfn == Pfn::None() || free_pages_ < low_watermark_;
+  lock.unlock();
+  // shrinkers allocate and free, so they must not be kicked off with the
+  // lock held
+  if (unlikely(pressure))
+    NotifyPressure();
+  return pfn;
+}
 
+ebbrt::Pfn ebbrt::PageAllocator::AllocLocked(size_t order, uint64_t max_addr) {
   FreePage* fp = nullptr;
   auto this_order = order;
   while (this_order <= kMaxOrder) {
@@ -114,6 +180,8 @@ ebbrt::Pfn ebbrt::PageAllocator::AllocLocal(size_t order, uint64_t max_addr) {
   auto page = mem_map::PfnToPage(fp->pfn());
   kassert(page != nullptr);
   page->usage = mem_map::Page::Usage::kInUse;
+  ++allocs_;
+  free_pages_ -= 1 << order;
 #ifdef PAGE_CHECKER
   kassert(AllocateAndCheck(pfn, order));
   kassert(Validate());
@@ -121,8 +189,103 @@ ebbrt::Pfn ebbrt::PageAllocator::AllocLocal(size_t order, uint64_t max_addr) {
   return pfn;
 }
 
+ebbrt::PageAllocator::FreePageList&
+ebbrt::PageAllocator::CpuCacheList(CpuCache& cache, size_t order) {
+  return order == 0 ? cache.small : cache.large;
+}
+
+ebbrt::Pfn ebbrt::PageAllocator::AllocCached(size_t order) {
+  TouchStack();
+
+  auto& cache = (*cpu_caches_)[Cpu::GetMine()];
+  auto& list = CpuCacheList(cache, order);
+  auto& allocator = (*allocators)[Cpu::GetMyNode().val()];
+  std::unique_lock<SpinLock> lock(cache.lock);
+  auto pressure = false;
+  if (unlikely(list.empty())) {
+    pressure = allocator.Refill(list, order);
+    if (list.empty()) {
+      lock.unlock();
+      // drains the other cores' caches before giving up
+      return allocator.AllocLocal(order, UINT64_MAX);
+    }
+  }
+  auto& fp = list.front();
+  list.pop_front();
+  CountCpuCache(cache);
+  lock.unlock();
+  if (unlikely(pressure))
+    allocator.NotifyPressure();
+  return fp.pfn();
+}
+
+void ebbrt::PageAllocator::FreeCached(Pfn pfn, size_t order) {
+  TouchStack();
+
+  auto& cache = (*cpu_caches_)[Cpu::GetMine()];
+  auto& list = CpuCacheList(cache, order);
+  std::lock_guard<SpinLock> lock(cache.lock);
+  list.push_front(*PfnToFreePage(pfn));
+  if (unlikely(list.size() > CpuCacheHigh(order))) {
+    auto& allocator = (*allocators)[Cpu::GetMyNode().val()];
+    allocator.Drain(list, order, CpuCacheBatch(order));
+  }
+  CountCpuCache(cache);
+}
+
+// Move a batch of pages from the buddy allocator into a per core cache,
+// returns whether the node is short of memory. The caller notifies the
+// shrinkers once it has unlocked the cache, as they allocate and free.
+bool ebbrt::PageAllocator::Refill(FreePageList& list, size_t order) {
+  std::lock_guard<SpinLock> lock(lock_);
+  for (size_t i = 0; i < CpuCacheBatch(order); ++i) {
+    auto pfn = AllocLocked(order, UINT64_MAX);
+    if (pfn == Pfn::None())
+      return true;
+    list.push_front(*PfnToFreePage(pfn));
+  }
+  return free_pages_ < low_watermark_;
+}
+
+// Return up to count pages from a per core cache to the buddy allocator
+void ebbrt::PageAllocator::Drain(FreePageList& list, size_t order,
+                                 size_t count) {
+  std::lock_guard<SpinLock> lock(lock_);
+  for (size_t i = 0; i < count && !list.empty(); ++i) {
+    auto& fp = list.front();
+    list.pop_front();
+    FreeLocked(fp.pfn(), order);
+  }
+}
+
+void ebbrt::PageAllocator::DrainCpuCache(CpuCache& cache) {
+  std::lock_guard<SpinLock> lock(cache.lock);
+  Drain(cache.small, 0, SIZE_MAX);
+  Drain(cache.large, kLargeOrder, SIZE_MAX);
+  CountCpuCache(cache);
+}
+
+// Drain the caches of every core on this node, must be called without any
+// cache locked
+void ebbrt::PageAllocator::DrainCpuCaches() {
+  // cores only cache pages from their own node
+  for (size_t i = 0; i < Cpu::Count(); ++i) {
+    if (Cpu::GetByIndex(i)->nid() == nid_)
+      DrainCpuCache((*cpu_caches_)[i]);
+  }
+}
+
+void ebbrt::PageAllocator::CountCpuCache(CpuCache& cache) {
+  cache.pages.store(cache.small.size() + (cache.large.size() << kLargeOrder),
+                    std::memory_order_relaxed);
+}
+
 ebbrt::Pfn ebbrt::PageAllocator::Alloc(size_t order, Nid nid,
                                        uint64_t max_addr) {
+  if ((order == 0 || (order == kLargeOrder && large_cache_enabled)) &&
+      max_addr == UINT64_MAX && nid == Cpu::GetMyNode()) {
+    return AllocCached(order);
+  }
   if (nid == nid_) {
     return AllocLocal(order, max_addr);
   } else {
@@ -130,6 +293,153 @@ ebbrt::Pfn ebbrt::PageAllocator::Alloc(size_t order, Nid nid,
   }
 }
 
+ebbrt::Pfn ebbrt::PageAllocator::AllocZeroed(Nid nid) {
+  if (nid == nid_) {
+    return AllocZeroedLocal();
+  } else {
+    return (*allocators)[nid.val()].AllocZeroedLocal();
+  }
+}
+
+ebbrt::Pfn ebbrt::PageAllocator::AllocZeroedLocal() {
+  TouchStack();
+
+  std::unique_lock<SpinLock> lock(zeroed_lock_);
+  if (likely(!zeroed_.empty())) {
+    auto& fp = zeroed_.front();
+    zeroed_.pop_front();
+    auto low = zeroed_.size() < kZeroedPoolLow;
+    lock.unlock();
+    if (low && nid_ == Cpu::GetMyNode())
+      StartZeroing();
+    // only the list hook was written since the page was zeroed
+    std::memset(static_cast<void*>(&fp), 0, sizeof(FreePage));
+    return fp.pfn();
+  }
+  lock.unlock();
+
+  if (nid_ == Cpu::GetMyNode())
+    StartZeroing();
+  auto pfn = Alloc(0, nid_);
+  if (pfn != Pfn::None())
+    std::memset(reinterpret_cast<void*>(pfn.ToAddr()), 0, pmem::kPageSize);
+  return pfn;
+}
+
+// Zero one page into the pool, returns false once the pool is full or the
+// node is short of memory
+bool ebbrt::PageAllocator::ZeroPage() {
+  {
+    std::lock_guard<SpinLock> lock(zeroed_lock_);
+    if (zeroed_.size() >= kZeroedPoolTarget)
+      return false;
+  }
+  // the pool would only be drained again by the shrinkers
+  if (pressure_)
+    return false;
+
+  auto pfn = Alloc(0, nid_);
+  if (pfn == Pfn::None())
+    return false;
+  std::memset(reinterpret_cast<void*>(pfn.ToAddr()), 0, pmem::kPageSize);
+
+  std::lock_guard<SpinLock> lock(zeroed_lock_);
+  zeroed_.push_front(*PfnToFreePage(pfn));
+  return zeroed_.size() < kZeroedPoolTarget;
+}
+
+void ebbrt::PageAllocator::StartZeroing() {
+  if (zeroing_enabled)
+    (*zero_callbacks)[Cpu::GetMine()]->Start();
+}
+
+void ebbrt::PageAllocator::EnablePreZeroing() { zeroing_enabled = true; }
+
+void ebbrt::PageAllocator::EnableLargePageCache() {
+  large_cache_enabled = true;
+}
+
+ebbrt::PageAllocator::Stats ebbrt::PageAllocator::GetStats(Nid nid) {
+  auto& allocator = (*allocators)[nid.val()];
+  Stats stats;
+  {
+    std::lock_guard<SpinLock> lock(allocator.lock_);
+    stats.allocs = allocator.allocs_;
+    stats.frees = allocator.frees_;
+    stats.free_pages = 0;
+    for (size_t order = 0; order <= kMaxOrder; ++order) {
+      stats.free_blocks[order] = allocator.free_page_lists[order].size();
+      stats.free_pages += stats.free_blocks[order] << order;
+    }
+  }
+  {
+    std::lock_guard<SpinLock> lock(allocator.zeroed_lock_);
+    stats.zeroed_pages = allocator.zeroed_.size();
+  }
+  // cores only cache pages from their own node
+  stats.cached_pages = 0;
+  for (size_t i = 0; i < Cpu::Count(); ++i) {
+    if (Cpu::GetByIndex(i)->nid() == nid)
+      stats.cached_pages +=
+          (*cpu_caches_)[i].pages.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void ebbrt::PageAllocator::RegisterShrinker(Shrinker& shrinker) {
+  std::lock_guard<SpinLock> lock(shrinkers->lock);
+  shrinkers->list.push_back(shrinker);
+}
+
+void ebbrt::PageAllocator::UnregisterShrinker(Shrinker& shrinker) {
+  std::lock_guard<SpinLock> lock(shrinkers->lock);
+  shrinkers->list.erase(shrinkers->list.iterator_to(shrinker));
+}
+
+void ebbrt::PageAllocator::EnableShrinking() { shrinkers->enabled = true; }
+
+void ebbrt::PageAllocator::SetLowWatermark(Nid nid, size_t pages) {
+  auto& allocator = (*allocators)[nid.val()];
+  std::lock_guard<SpinLock> lock(allocator.lock_);
+  allocator.low_watermark_ = pages;
+}
+
+// Start a round of shrinking on every core unless one is already underway
+void ebbrt::PageAllocator::NotifyPressure() {
+  if (!shrinkers->enabled || pressure_.exchange(true))
+    return;
+
+  auto ncpus = Cpu::Count();
+  shrinking_cores_ = ncpus;
+  for (size_t i = 0; i < ncpus; ++i) {
+    event_manager->SpawnRemote([this]() { RunShrinkers(); }, i);
+  }
+}
+
+void ebbrt::PageAllocator::RunShrinkers() {
+  {
+    std::lock_guard<SpinLock> lock(shrinkers->lock);
+    for (auto& shrinker : shrinkers->list) {
+      shrinker.Shrink(nid_);
+    }
+  }
+  if (Cpu::GetMyNode() == nid_) {
+    // hand the zeroed pool back, idle cores refill it once pressure is gone
+    FreePageList zeroed;
+    {
+      std::lock_guard<SpinLock> lock(zeroed_lock_);
+      zeroed.swap(zeroed_);
+    }
+    Drain(zeroed, 0, SIZE_MAX);
+    // pages released by the shrinkers may have landed in this core's cache
+    DrainCpuCache((*cpu_caches_)[Cpu::GetMine()]);
+  }
+  // the last core re-arms the notification, if the node is still short of
+  // memory the next allocation starts another round
+  if (shrinking_cores_.fetch_sub(1) == 1)
+    pressure_ = false;
+}
+
 void ebbrt::PageAllocator::FreePageNoCoalesce(Pfn pfn, size_t order) {
   auto entry = PfnToFreePage(pfn);
   free_page_lists[order].push_front(*entry);
@@ -140,11 +450,25 @@ void ebbrt::PageAllocator::FreePageNoCoalesce(Pfn pfn, size_t order) {
 }
 
 void ebbrt::PageAllocator::Free(Pfn pfn, size_t order) {
+  if (order == 0 || (order == kLargeOrder && large_cache_enabled)) {
+    auto page = mem_map::PfnToPage(pfn);
+    kassert(page != nullptr);
+    if (Nid(page->nid) == Cpu::GetMyNode()) {
+      FreeCached(pfn, order);
+      return;
+    }
+  }
   std::lock_guard<SpinLock> lock(lock_);
+  FreeLocked(pfn, order);
+}
+
+void ebbrt::PageAllocator::FreeLocked(Pfn pfn, size_t order) {
 #ifdef PAGE_CHECKER
   kassert(Release(pfn, order));
 #endif
   kassert(order <= kMaxOrder);
+  ++frees_;
+  free_pages_ += 1 << order;
   while (order < kMaxOrder) {
     auto buddy = PfnToBuddy(pfn, order);
     auto page = mem_map::PfnToPage(buddy);
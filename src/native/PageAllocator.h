@@ -5,11 +5,15 @@
 #ifndef BAREMETAL_SRC_INCLUDE_EBBRT_PAGEALLOCATOR_H_
 #define BAREMETAL_SRC_INCLUDE_EBBRT_PAGEALLOCATOR_H_
 
+#include <array>
+#include <atomic>
+
 // #define PAGE_CHECKER
 
 #ifdef PAGE_CHECKER
 #include <boost/container/static_vector.hpp>
 #endif
+
 #include <boost/intrusive/list.hpp>
 
 #include "../CacheAligned.h"
@@ -25,7 +29,36 @@ namespace ebbrt {
 
 class PageAllocator : public CacheAligned {
  public:
-  static const constexpr size_t kMaxOrder = 11;
+  static const constexpr size_t kMaxOrder = 18;
+  // order of a 2MB page
+  static const constexpr size_t kLargeOrder = 9;
+  // order of a 1GB page
+  static const constexpr size_t kHugeOrder = 18;
+
+  struct Stats {
+    uint64_t allocs;
+    uint64_t frees;
+    // pages free in the buddy allocator
+    uint64_t free_pages;
+    // free pages held in the per core caches of the node's cores and in its
+    // zeroed page pool, these are not included in free_pages
+    uint64_t cached_pages;
+    uint64_t zeroed_pages;
+    // free blocks of each order, a node with free pages but few high order
+    // blocks is fragmented
+    std::array<uint64_t, kMaxOrder + 1> free_blocks;
+  };
+
+  // Memory that can be handed back to the page allocator. Once shrinking is
+  // enabled, a node whose free pages fall below its low watermark has Shrink
+  // invoked on every core, each core should release what it caches from that
+  // node. Shrink runs as an ordinary event and must not (un)register
+  // shrinkers.
+  class Shrinker : public boost::intrusive::list_base_hook<> {
+   public:
+    virtual ~Shrinker() {}
+    virtual void Shrink(Nid nid) = 0;
+  };
 
   explicit PageAllocator(Nid nid);
 
@@ -34,6 +67,25 @@ class PageAllocator : public CacheAligned {
   Pfn Alloc(size_t order = 0, Nid nid = Cpu::GetMyNode(),
             uint64_t max_addr = UINT64_MAX);
   void Free(Pfn pfn, size_t order = 0);
+  // Allocate an order 0 page filled with zeroes. Pages are taken from a per
+  // node pool that idle cores keep topped up, so the caller only pays for
+  // the memset when the pool has run dry.
+  Pfn AllocZeroed(Nid nid = Cpu::GetMyNode());
+  static Stats GetStats(Nid nid);
+
+  static void RegisterShrinker(Shrinker& shrinker);
+  static void UnregisterShrinker(Shrinker& shrinker);
+  // Start delivering pressure notifications, the event managers of all cores
+  // must be running
+  static void EnableShrinking();
+  static void SetLowWatermark(Nid nid, size_t pages);
+  // Start refilling the zeroed page pools from idle cores, the event managers
+  // of all cores must be running
+  static void EnablePreZeroing();
+  // Also serve 2MB pages from the per core caches. Each core may then hold
+  // on to several of them, so this suits applications that allocate and
+  // free large pages at a high rate.
+  static void EnableLargePageCache();
 
  private:
   class FreePage {
@@ -63,9 +115,43 @@ class PageAllocator : public CacheAligned {
     return new (reinterpret_cast<void*>(addr)) FreePage();
   }
 
+  // Order 0 (and, once enabled, large page) allocations on a core's own node
+  // are served from per core caches, which are refilled from and drained to
+  // the buddy allocator a batch at a time. The lock is only contended when a
+  // core of the node runs out of memory and drains the others' caches.
+  struct CpuCache : public CacheAligned {
+    SpinLock lock;
+    FreePageList small;
+    FreePageList large;
+    // pages held in both lists, read by other cores for statistics
+    std::atomic<size_t> pages{0};
+  };
+
+  static constexpr size_t CpuCacheBatch(size_t order) {
+    return order == 0 ? 16 : 1;
+  }
+  static constexpr size_t CpuCacheHigh(size_t order) {
+    return 4 * CpuCacheBatch(order);
+  }
+
   static void EarlyFreePage(Pfn start, size_t order, Nid nid);
   Pfn AllocLocal(size_t order, size_t max_addr);
+  Pfn AllocLocked(size_t order, size_t max_addr);
+  void FreeLocked(Pfn pfn, size_t order);
+  static FreePageList& CpuCacheList(CpuCache& cache, size_t order);
+  static Pfn AllocCached(size_t order);
+  static void FreeCached(Pfn pfn, size_t order);
+  bool Refill(FreePageList& list, size_t order);
+  void Drain(FreePageList& list, size_t order, size_t count);
+  void DrainCpuCache(CpuCache& cache);
+  void DrainCpuCaches();
+  static void CountCpuCache(CpuCache& cache);
   void FreePageNoCoalesce(Pfn pfn, size_t order);
+  void NotifyPressure();
+  void RunShrinkers();
+  Pfn AllocZeroedLocal();
+  bool ZeroPage();
+  static void StartZeroing();
 #ifdef PAGE_CHECKER
   bool Validate() const;
   bool AllocateAndCheck(Pfn pfn, size_t order);
@@ -75,9 +161,25 @@ class PageAllocator : public CacheAligned {
   static ExplicitlyConstructed<
       boost::container::static_vector<PageAllocator, numa::kMaxNodes>>
       allocators;
+  static ExplicitlyConstructed<std::array<CpuCache, Cpu::kMaxCpus>> cpu_caches_;
   SpinLock lock_;
   Nid nid_;
   std::array<FreePageList, kMaxOrder + 1> free_page_lists;
+  uint64_t allocs_ = 0;
+  uint64_t frees_ = 0;
+  size_t free_pages_ = 0;
+  // by default, a node is under pressure once less than 1/64th of the memory
+  // it started with is free
+  static const constexpr size_t kDefaultWatermarkShift = 6;
+  size_t low_watermark_ = 0;
+  // set while a round of shrinking is in progress
+  std::atomic<bool> pressure_{false};
+  std::atomic<size_t> shrinking_cores_{0};
+  // pages zeroed ahead of time, counted as allocated by the buddy allocator
+  static const constexpr size_t kZeroedPoolTarget = 64;
+  static const constexpr size_t kZeroedPoolLow = kZeroedPoolTarget / 2;
+  SpinLock zeroed_lock_;
+  FreePageList zeroed_;
 
 #ifdef PAGE_CHECKER
   struct Allocation {
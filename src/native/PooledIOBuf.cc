@@ -0,0 +1,232 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "PooledIOBuf.h"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <boost/intrusive/slist.hpp>
+
+#include "../CacheAligned.h"
+#include "../Compiler.h"
+#include "../SpinLock.h"
+#include "Cpu.h"
+#include "Debug.h"
+#include "PageAllocator.h"
+
+namespace {
+// blocks from 512 bytes up to 128KB, enough for a 64KB receive buffer
+const constexpr size_t kMinClassShift = 9;
+const constexpr size_t kMaxClassShift = 17;
+const constexpr uint32_t kNumClasses = kMaxClassShift - kMinClassShift + 1;
+// larger buffers bypass the pool
+const constexpr uint32_t kUnpooled = kNumClasses;
+// blocks of each class a pool holds on to, enough to refill a receive ring
+const constexpr size_t kMaxCachedPerClass = 256;
+
+// Precedes the descriptor of every pooled buffer. The hook is only used while
+// the block sits in a pool.
+struct BlockHeader {
+  boost::intrusive::slist_member_hook<
+      boost::intrusive::link_mode<boost::intrusive::normal_link>>
+      hook;
+  uint32_t cpu;
+  uint32_t size_class;
+};
+
+typedef boost::intrusive::slist<  // NOLINT
+    BlockHeader,
+    boost::intrusive::member_hook<
+        BlockHeader, boost::intrusive::slist_member_hook<
+                         boost::intrusive::link_mode<
+                             boost::intrusive::normal_link>>,
+        &BlockHeader::hook>>
+    BlockList;
+
+// The free blocks of one core. Only the owning core allocates from it, blocks
+// freed on other cores are queued on the remote list until the owner next
+// runs short.
+class IOBufPool : public ebbrt::CacheAligned,
+                  public ebbrt::PageAllocator::Shrinker {
+ public:
+  explicit IOBufPool(size_t cpu);
+
+  static IOBufPool& Mine();
+  static void Free(BlockHeader* block);
+
+  BlockHeader* Alloc(size_t size);
+  void Shrink(ebbrt::Nid nid) override;
+  ebbrt::PooledIOBufStats GetStats() const;
+
+ private:
+  void FreeLocal(BlockHeader* block);
+  void FreeRemote(BlockHeader* block);
+  void ClaimRemoteList();
+
+  size_t cpu_;
+  std::array<BlockList, kNumClasses> free_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t remote_frees_ = 0;
+  struct Remote : public ebbrt::CacheAligned {
+    ebbrt::SpinLock lock;
+    BlockList list;
+  } remote_;
+  std::atomic<bool> remote_check_{false};
+};
+
+// created by each core the first time it allocates a pooled buffer
+std::array<IOBufPool*, ebbrt::Cpu::kMaxCpus> pools;
+
+IOBufPool::IOBufPool(size_t cpu) : cpu_(cpu) {
+  ebbrt::PageAllocator::RegisterShrinker(*this);
+}
+
+IOBufPool& IOBufPool::Mine() {
+  auto cpu = static_cast<size_t>(ebbrt::Cpu::GetMine());
+  if (unlikely(pools[cpu] == nullptr)) {
+    pools[cpu] = new IOBufPool(cpu);
+  }
+  return *pools[cpu];
+}
+
+BlockHeader* IOBufPool::Alloc(size_t size) {
+  auto shift = size <= (size_t(1) << kMinClassShift)
+                   ? kMinClassShift
+                   : sizeof(size_t) * 8 - __builtin_clzl(size - 1);
+  auto size_class = kUnpooled;
+  if (likely(shift <= kMaxClassShift)) {
+    size_class = shift - kMinClassShift;
+    auto& list = free_[size_class];
+    if (list.empty() && remote_check_)
+      ClaimRemoteList();
+    if (likely(!list.empty())) {
+      ++hits_;
+      auto& block = list.front();
+      list.pop_front();
+      return &block;
+    }
+    size = size_t(1) << shift;
+  }
+
+  ++misses_;
+  auto p = std::malloc(size);
+  if (p == nullptr)
+    return nullptr;
+  auto block = new (p) BlockHeader();
+  block->cpu = cpu_;
+  block->size_class = size_class;
+  return block;
+}
+
+void IOBufPool::Free(BlockHeader* block) {
+  if (block->size_class == kUnpooled) {
+    std::free(block);
+    return;
+  }
+
+  auto& pool = *pools[block->cpu];
+  if (block->cpu == ebbrt::Cpu::GetMine()) {
+    pool.FreeLocal(block);
+  } else {
+    pool.FreeRemote(block);
+  }
+}
+
+void IOBufPool::FreeLocal(BlockHeader* block) {
+  auto& list = free_[block->size_class];
+  if (unlikely(list.size() >= kMaxCachedPerClass)) {
+    std::free(block);
+    return;
+  }
+  list.push_front(*block);
+}
+
+void IOBufPool::FreeRemote(BlockHeader* block) {
+  std::lock_guard<ebbrt::SpinLock> lock(remote_.lock);
+  remote_.list.push_front(*block);
+  remote_check_ = true;
+}
+
+void IOBufPool::ClaimRemoteList() {
+  BlockList list;
+  {
+    std::lock_guard<ebbrt::SpinLock> lock(remote_.lock);
+    list.swap(remote_.list);
+    remote_check_ = false;
+  }
+  remote_frees_ += list.size();
+  while (!list.empty()) {
+    auto& block = list.front();
+    list.pop_front();
+    FreeLocal(&block);
+  }
+}
+
+// Under memory pressure the owning core hands every cached block back to the
+// general purpose allocator
+void IOBufPool::Shrink(ebbrt::Nid nid) {
+  if (ebbrt::Cpu::GetMine() != cpu_ || ebbrt::Cpu::GetMyNode() != nid)
+    return;
+
+  ClaimRemoteList();
+  for (auto& list : free_) {
+    while (!list.empty()) {
+      auto& block = list.front();
+      list.pop_front();
+      std::free(&block);
+    }
+  }
+}
+
+ebbrt::PooledIOBufStats IOBufPool::GetStats() const {
+  ebbrt::PooledIOBufStats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.remote_frees = remote_frees_;
+  stats.cached = 0;
+  for (auto& list : free_) {
+    stats.cached += list.size();
+  }
+  return stats;
+}
+}  // namespace
+
+ebbrt::PooledIOBufOwner::PooledIOBufOwner(uint8_t* p, size_t capacity)
+    : ptr_(p), capacity_(capacity) {}
+
+const uint8_t* ebbrt::PooledIOBufOwner::Buffer() const { return ptr_; }
+
+size_t ebbrt::PooledIOBufOwner::Capacity() const { return capacity_; }
+
+void ebbrt::PooledIOBufOwner::operator delete(void* ptr) {
+  IOBufPool::Free(static_cast<BlockHeader*>(ptr) - 1);
+}
+
+std::unique_ptr<ebbrt::MutPooledIOBuf>
+ebbrt::MakePooledIOBuf(size_t capacity, bool zero_memory) {
+  auto size = sizeof(BlockHeader) + sizeof(MutPooledIOBuf) + capacity;
+  auto block = IOBufPool::Mine().Alloc(size);
+
+  if (unlikely(block == nullptr))
+    throw std::bad_alloc();
+
+  auto b = static_cast<void*>(block + 1);
+  auto buf = static_cast<uint8_t*>(b) + sizeof(MutPooledIOBuf);
+  if (zero_memory)
+    std::memset(buf, 0, capacity);
+
+  return std::unique_ptr<MutPooledIOBuf>(new (b) MutPooledIOBuf(buf, capacity));
+}
+
+ebbrt::PooledIOBufStats ebbrt::GetPooledIOBufStats(size_t cpu) {
+  kassert(cpu < Cpu::kMaxCpus);
+  if (pools[cpu] == nullptr)
+    return PooledIOBufStats();
+  return pools[cpu]->GetStats();
+}
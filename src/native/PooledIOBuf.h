@@ -0,0 +1,95 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BAREMETAL_SRC_INCLUDE_EBBRT_POOLEDIOBUF_H_
+#define BAREMETAL_SRC_INCLUDE_EBBRT_POOLEDIOBUF_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "../IOBuf.h"
+
+namespace ebbrt {
+class PooledIOBufOwner;
+
+typedef IOBufBase<PooledIOBufOwner> PooledIOBuf;
+typedef MutIOBufBase<PooledIOBufOwner> MutPooledIOBuf;
+
+// Drop in replacement for MakeUniqueIOBuf for buffers that are allocated and
+// freed at a high rate (e.g. packet buffers). The descriptor and data are
+// carved from a block kept in a per core pool of power of two size classes.
+// Freeing the buffer returns the block to the pool of the core that allocated
+// it, wherever the free happens.
+std::unique_ptr<MutPooledIOBuf> MakePooledIOBuf(size_t capacity,
+                                                bool zero_memory = false);
+
+// Counters of a core's pool. They are only written by the owning core,
+// readers on other cores may see slightly stale values.
+struct PooledIOBufStats {
+  // allocations served from the pool
+  uint64_t hits;
+  // allocations that went to the general purpose allocator
+  uint64_t misses;
+  // buffers of this core freed on another core
+  uint64_t remote_frees;
+  // blocks currently held by the pool
+  uint64_t cached;
+};
+
+PooledIOBufStats GetPooledIOBufStats(size_t cpu);
+
+class PooledIOBufOwner {
+ public:
+  const uint8_t* Buffer() const;
+  size_t Capacity() const;
+  // delete returns the block holding the buffer and descriptor(this) to its
+  // pool
+  void operator delete(void* ptr);
+
+ private:
+  // Private because it should not be called directly, use MakePooledIOBuf
+  PooledIOBufOwner(uint8_t* p, size_t capacity);
+
+  uint8_t* ptr_;
+  size_t capacity_;
+
+  friend class IOBufBase<PooledIOBufOwner>;
+  friend class MutIOBufBase<PooledIOBufOwner>;
+};
+
+// These template specializations ensure that the private constructor remains
+// hidden
+template <>
+class IOBufBase<PooledIOBufOwner> : public PooledIOBufOwner, public IOBuf {
+ public:
+  const uint8_t* Buffer() const override { return PooledIOBufOwner::Buffer(); }
+
+  size_t Capacity() const override { return PooledIOBufOwner::Capacity(); }
+
+ private:
+  IOBufBase(uint8_t* p, size_t capacity)
+      : PooledIOBufOwner(p, capacity), IOBuf(p, capacity) {}
+
+  friend std::unique_ptr<MutPooledIOBuf>
+  ebbrt::MakePooledIOBuf(size_t capacity, bool zero_memory);
+};
+
+template <>
+class MutIOBufBase<PooledIOBufOwner> : public PooledIOBufOwner,
+                                       public MutIOBuf {
+ public:
+  const uint8_t* Buffer() const override { return PooledIOBufOwner::Buffer(); }
+
+  size_t Capacity() const override { return PooledIOBufOwner::Capacity(); }
+
+ private:
+  MutIOBufBase(uint8_t* p, size_t capacity)
+      : PooledIOBufOwner(p, capacity), MutIOBuf(p, capacity) {}
+
+  friend std::unique_ptr<MutPooledIOBuf>
+  ebbrt::MakePooledIOBuf(size_t capacity, bool zero_memory);
+};
+}  // namespace ebbrt
+
+#endif  // BAREMETAL_SRC_INCLUDE_EBBRT_POOLEDIOBUF_H_
@@ -62,5 +62,17 @@ CallRcu(F&& f, Args&&... args) {
   return CallRcuHelper(std::forward<F>(f), std::forward<Args>(args)...);
 }
 
+// Returns a future that is fulfilled once a grace period has elapsed. The
+// grace period is started immediately and all cores are interrupted to begin
+// looking for quiescent states. Use with Then: an event blocked on the future
+// keeps its core from ever becoming quiescent.
+inline Future<void> SynchronizeRcuExpedited() {
+  auto p = Promise<void>();
+  auto ret = p.GetFuture();
+  event_manager->DoRcu([prom = std::move(p)]() mutable { prom.SetValue(); });
+  EventManager::ExpediteRcu();
+  return ret;
+}
+
 }  // namespace ebbrt
 #endif  // BAREMETAL_SRC_INCLUDE_EBBRT_RCU_H_
@@ -43,8 +43,8 @@ size_t CalculateOrder(size_t size) {
   if (order <= 1)
     return order;
 
-  order = SlabOrder(size, ebbrt::PageAllocator::kMaxOrder, 0);
-  ebbrt::kbugon(order > ebbrt::PageAllocator::kMaxOrder,
+  order = SlabOrder(size, ebbrt::SlabAllocator::kMaxSlabOrder, 0);
+  ebbrt::kbugon(order > ebbrt::SlabAllocator::kMaxSlabOrder,
                 "Request for too big a slab\n");
   return order;
 }
@@ -209,6 +209,7 @@ void ebbrt::SlabCache::AddSlab(Pfn pfn) {
   }
 
   partial_page_list_.push_front(*page);
+  ++slab_grows_;
 }
 
 void ebbrt::SlabCache::Free(void* p) {
@@ -224,36 +225,50 @@ void ebbrt::SlabCache::FlushFreeList(size_t amount) {
   while (!object_list_.empty() && freed < amount) {
     auto& object = object_list_.front();
     object_list_.pop_front();
-    auto obj_addr = object.addr();
-    auto pfn = AddrToSlabPfn(obj_addr, root_.order());
-    auto page = mem_map::PfnToPage(pfn);
-    kassert(page != nullptr);
+    FreeToSlab(object.addr());
+    ++freed;
+  }
+}
+
+// Return every object on list to its slab
+void ebbrt::SlabCache::FlushList(FreeObjectList& list) {
+  while (!list.empty()) {
+    auto& object = list.front();
+    list.pop_front();
+    FreeToSlab(object.addr());
+  }
+}
 
-    auto& page_slab_data = page->data.slab_data;
+// Return an object to its slab, or to the cache owning the slab
+void ebbrt::SlabCache::FreeToSlab(void* obj_addr) {
+  auto pfn = AddrToSlabPfn(obj_addr, root_.order());
+  auto page = mem_map::PfnToPage(pfn);
+  kassert(page != nullptr);
 
-    if (page_slab_data.cache != this) {
-      auto& allocator = root_.GetCpuAllocator();
-      allocator.FreeRemote(obj_addr);
-    } else {
-      auto object = new (obj_addr) FreeObject();
-      page_slab_data.list->push_front(*object);
-      --page_slab_data.used;
-
-      if (page_slab_data.used == 0) {
-        if (root_.NumObjectsPerSlab() > 1) {
-          partial_page_list_.erase(partial_page_list_.iterator_to(*page));
-        }
-
-        // free the page
-        page_slab_data.member_hook.destruct();
-        page_slab_data.list.destruct();
-        page_allocator->Free(pfn, root_.order());
-      } else if (page_slab_data.used + 1 == root_.NumObjectsPerSlab()) {
-        partial_page_list_.push_front(*page);
-      }
+  auto& page_slab_data = page->data.slab_data;
+
+  if (page_slab_data.cache != this) {
+    auto& allocator = root_.GetCpuAllocator();
+    allocator.FreeRemote(obj_addr);
+    return;
+  }
+
+  auto object = new (obj_addr) FreeObject();
+  page_slab_data.list->push_front(*object);
+  --page_slab_data.used;
+
+  if (page_slab_data.used == 0) {
+    if (root_.NumObjectsPerSlab() > 1) {
+      partial_page_list_.erase(partial_page_list_.iterator_to(*page));
     }
 
-    ++freed;
+    // free the page
+    page_slab_data.member_hook.destruct();
+    page_slab_data.list.destruct();
+    page_allocator->Free(pfn, root_.order());
+    ++slab_shrinks_;
+  } else if (page_slab_data.used + 1 == root_.NumObjectsPerSlab()) {
+    partial_page_list_.push_front(*page);
   }
 }
 
@@ -319,6 +334,30 @@ void ebbrt::SlabAllocator::operator delete(void* p) {
 }
 
 void* ebbrt::SlabAllocator::Alloc() {
+  ++stats_.allocs;
+  if (likely(!loaded_.empty())) {
+    auto& object = loaded_.front();
+    loaded_.pop_front();
+    return object.addr();
+  }
+  return AllocSlow();
+}
+
+void* ebbrt::SlabAllocator::AllocSlow() {
+  // the previous magazine can only be full or empty here
+  if (previous_.empty()) {
+    auto& depot = cache_.root_.GetNodeAllocator(Cpu::GetMyNode());
+    if (depot.GetMagazine(previous_))
+      ++stats_.depot_gets;
+  }
+  if (!previous_.empty()) {
+    loaded_.swap(previous_);
+    auto& object = loaded_.front();
+    loaded_.pop_front();
+    return object.addr();
+  }
+
+  // nothing cached on the node, go to the slab layer
   auto ret = cache_.Alloc();
   if (unlikely(ret == nullptr)) {
     auto pfn = page_allocator->Alloc(cache_.root_.order(), Cpu::GetMyNode());
@@ -332,19 +371,10 @@ void* ebbrt::SlabAllocator::Alloc() {
 }
 
 void* ebbrt::SlabAllocator::AllocNid(Nid nid) {
-  if (nid == Cpu::GetMyNode()) {
-    auto ret = cache_.Alloc();
-    if (ret == nullptr) {
-      auto pfn = page_allocator->Alloc(cache_.root_.order(), nid);
-      if (pfn == Pfn::None())
-        return nullptr;
-      cache_.AddSlab(pfn);
-      ret = cache_.Alloc();
-      kassert(ret != nullptr);
-    }
-    return ret;
-  }
+  if (nid == Cpu::GetMyNode())
+    return Alloc();
 
+  ++stats_.allocs;
   auto& node_allocator = cache_.root_.GetNodeAllocator(nid);
   return node_allocator.Alloc();
 }
@@ -353,12 +383,57 @@ void ebbrt::SlabAllocator::Free(void* p) {
   auto page = mem_map::AddrToPage(p);
   kassert(page != nullptr);
 
+  ++stats_.frees;
   auto nid = page->nid;
-  if (Nid(nid) == Cpu::GetMyNode()) {
-    cache_.Free(p);
-  } else {
+  if (unlikely(Nid(nid) != Cpu::GetMyNode())) {
+    ++stats_.remote_frees;
     FreeRemote(p);
+    return;
+  }
+
+  if (likely(loaded_.size() < cache_.root_.free_batch())) {
+    auto object = new (p) FreeObject();
+    loaded_.push_front(*object);
+    return;
   }
+  FreeSlow(p);
+}
+
+void ebbrt::SlabAllocator::FreeSlow(void* p) {
+  // the loaded magazine is full, the previous one is full or empty
+  if (!previous_.empty()) {
+    auto& depot = cache_.root_.GetNodeAllocator(Cpu::GetMyNode());
+    if (depot.PutMagazine(previous_)) {
+      ++stats_.depot_puts;
+    } else {
+      // the depot is full too, give the objects back to their slabs
+      cache_.FlushList(previous_);
+    }
+  }
+  loaded_.swap(previous_);
+  auto object = new (p) FreeObject();
+  loaded_.push_front(*object);
+}
+
+ebbrt::SlabStats ebbrt::SlabAllocator::GetStats() const {
+  auto stats = stats_;
+  stats.slab_grows = cache_.slab_grows_;
+  stats.slab_shrinks = cache_.slab_shrinks_;
+  stats.slabs_held = cache_.slab_grows_ - cache_.slab_shrinks_;
+  stats.objects_cached = loaded_.size() + previous_.size();
+  return stats;
+}
+
+void ebbrt::SlabAllocator::Shrink() {
+  FlushMagazines();
+  FlushRemoteList();
+  cache_.ClaimRemoteFreeList();
+  cache_.FlushFreeListAll();
+}
+
+void ebbrt::SlabAllocator::FlushMagazines() {
+  cache_.FlushList(loaded_);
+  cache_.FlushList(previous_);
 }
 
 void ebbrt::SlabAllocator::FreeRemote(void* p) {
@@ -425,6 +500,56 @@ void ebbrt::SlabAllocatorNode::operator delete(void* p) {
   allocator.Free(p);
 }
 
+// Take a full magazine from the depot, magazine must be empty
+bool ebbrt::SlabAllocatorNode::GetMagazine(FreeObjectList& magazine) {
+  std::lock_guard<SpinLock> lock(depot_lock_);
+  if (depot_.empty())
+    return false;
+  magazine.swap(depot_.back());
+  depot_.pop_back();
+  return true;
+}
+
+// Hand a full magazine to the depot, on success magazine is left empty
+bool ebbrt::SlabAllocatorNode::PutMagazine(FreeObjectList& magazine) {
+  std::lock_guard<SpinLock> lock(depot_lock_);
+  if (depot_.size() == depot_.capacity())
+    return false;
+  depot_.emplace_back();
+  depot_.back().swap(magazine);
+  return true;
+}
+
+void ebbrt::SlabAllocatorNode::FlushDepot(SlabCache& cache) {
+  std::lock_guard<SpinLock> lock(depot_lock_);
+  for (auto& magazine : depot_) {
+    cache.FlushList(magazine);
+  }
+  depot_.clear();
+}
+
+void ebbrt::SlabAllocatorNode::Shrink(SlabCache& cache) {
+  FlushDepot(cache);
+  std::lock_guard<SpinLock> lock(lock_);
+  cache_.ClaimRemoteFreeList();
+  cache_.FlushFreeListAll();
+}
+
+ebbrt::SlabStats ebbrt::SlabAllocatorNode::GetStats() {
+  SlabStats stats;
+  {
+    std::lock_guard<SpinLock> lock(lock_);
+    stats.slab_grows = cache_.slab_grows_;
+    stats.slab_shrinks = cache_.slab_shrinks_;
+    stats.slabs_held = cache_.slab_grows_ - cache_.slab_shrinks_;
+  }
+  std::lock_guard<SpinLock> lock(depot_lock_);
+  for (auto& magazine : depot_) {
+    stats.objects_cached += magazine.size();
+  }
+  return stats;
+}
+
 void* ebbrt::SlabAllocatorNode::Alloc() {
   std::lock_guard<SpinLock> lock(lock_);
   auto ret = cache_.Alloc();
@@ -446,16 +571,31 @@ ebbrt::SlabAllocatorRoot::SlabAllocatorRoot(size_t size_in, size_t align_in)
       hiwater_(free_batch_ * 4) {
   std::fill(node_allocators_.begin(), node_allocators_.end(), nullptr);
   std::fill(cpu_allocators_.begin(), cpu_allocators_.end(), nullptr);
+  PageAllocator::RegisterShrinker(*this);
 }
 
 ebbrt::SlabAllocatorRoot::~SlabAllocatorRoot() {
+  PageAllocator::UnregisterShrinker(*this);
+
+  // Objects in the depots may belong to any cache, drain them through this
+  // core which queues foreign objects on their owner's remote list
+  auto& local_allocator = GetCpuAllocator();
+  for (auto& node_allocator : node_allocators_) {
+    auto allocator = node_allocator.load();
+    if (allocator != nullptr)
+      allocator->FlushDepot(local_allocator.cache_);
+  }
+
   for (auto& cpu_allocator : cpu_allocators_) {
     auto allocator = cpu_allocator.get();
     if (allocator != nullptr) {
+      allocator->FlushMagazines();
       allocator->cache_.FlushFreeListAll();
       allocator->FlushRemoteList();
     }
   }
+  // foreign objects flushed above were queued on this core
+  local_allocator.FlushRemoteList();
 
   for (auto& cpu_allocator : cpu_allocators_) {
     auto allocator = cpu_allocator.get();
@@ -513,6 +653,34 @@ ebbrt::SlabAllocatorRoot::GetCpuAllocator(size_t cpu_index) {
   return *allocator;
 }
 
+void ebbrt::SlabAllocatorRoot::Shrink(Nid nid) {
+  // only cores of the node cache its objects, remote frees are forwarded to
+  // the owning cache
+  if (Cpu::GetMyNode() != nid)
+    return;
+  auto allocator = cpu_allocators_[Cpu::GetMine()].get();
+  if (allocator == nullptr)
+    return;
+  allocator->Shrink();
+  auto node_allocator = node_allocators_[nid.val()].load();
+  if (node_allocator != nullptr)
+    node_allocator->Shrink(allocator->cache_);
+}
+
+ebbrt::SlabStats ebbrt::SlabAllocatorRoot::GetStats(size_t cpu_index) const {
+  auto allocator = cpu_allocators_[cpu_index].get();
+  if (allocator == nullptr)
+    return SlabStats();
+  return allocator->GetStats();
+}
+
+ebbrt::SlabStats ebbrt::SlabAllocatorRoot::GetNodeStats(Nid nid) const {
+  auto allocator = node_allocators_[nid.val()].load();
+  if (allocator == nullptr)
+    return SlabStats();
+  return allocator->GetStats();
+}
+
 ebbrt::SlabAllocatorNode& ebbrt::SlabAllocatorRoot::GetNodeAllocator(Nid nid) {
   size_t index = nid.val();
   auto allocator = node_allocators_[index].load();
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <memory>
 
+#include <boost/container/static_vector.hpp>
 #include <boost/intrusive/parent_from_member.hpp>
 
 #include "../Align.h"
@@ -28,6 +29,25 @@ void Init();
 
 struct SlabAllocatorRoot;
 
+// Counters of a per-core slab allocator. They are only written by the owning
+// core, readers on other cores may see slightly stale values.
+struct SlabStats {
+  uint64_t allocs = 0;
+  uint64_t frees = 0;
+  // frees of objects belonging to another NUMA node
+  uint64_t remote_frees = 0;
+  // slabs taken from and returned to the page allocator
+  uint64_t slab_grows = 0;
+  uint64_t slab_shrinks = 0;
+  // magazines exchanged with the node depot
+  uint64_t depot_gets = 0;
+  uint64_t depot_puts = 0;
+  // slabs currently owned by this core's cache
+  uint64_t slabs_held = 0;
+  // free objects cached in this core's magazines
+  uint64_t objects_cached = 0;
+};
+
 class SlabCache {
  public:
   struct Remote : public CacheAligned {
@@ -43,12 +63,17 @@ class SlabCache {
   void AddSlab(Pfn pfn);
   void FlushFreeList(size_t amount);
   void FlushFreeListAll();
+  void FlushList(FreeObjectList& list);
   void ClaimRemoteFreeList();
 
   SlabAllocatorRoot& root_;
   std::atomic<bool> remote_check;
+  uint64_t slab_grows_ = 0;
+  uint64_t slab_shrinks_ = 0;
 
  private:
+  void FreeToSlab(void* obj_addr);
+
   struct PageHookFunctor {
     typedef boost::intrusive::list_member_hook<
         boost::intrusive::link_mode<boost::intrusive::normal_link>>
@@ -100,8 +125,13 @@ class SlabCache {
 
 class SlabAllocator : public CacheAligned {
  public:
+  // Fixed rather than following PageAllocator::kMaxOrder, which grew to hand
+  // out 1GB blocks; a slab that large would pin a gigabyte per cache
+  static const constexpr size_t kMaxSlabOrder = 11;
   static const constexpr size_t kMaxSlabSize =
-      1 << (pmem::kPageShift + PageAllocator::kMaxOrder);
+      1 << (pmem::kPageShift + kMaxSlabOrder);
+  static_assert(kMaxSlabOrder <= PageAllocator::kMaxOrder,
+                "slabs must fit in a page allocator block");
 
   explicit SlabAllocator(SlabAllocatorRoot& root);
 
@@ -114,11 +144,24 @@ class SlabAllocator : public CacheAligned {
   void* AllocNid(Nid nid = Cpu::GetMyNode());
   void Free(void* p);
 
+  SlabStats GetStats() const;
+
  private:
+  void* AllocSlow();
+  void FreeSlow(void* p);
+  void Shrink();
+  void FlushMagazines();
   void FreeRemote(void* p);
   void FlushRemoteList();
 
+  // Objects freed on this core are cached in two magazines of up to
+  // free_batch() objects each. When both are exhausted (or full) whole
+  // magazines are exchanged with the depot of the node, so objects freed on
+  // one core flow to allocations on another without touching the slabs.
+  FreeObjectList loaded_;
+  FreeObjectList previous_;
   SlabCache cache_;
+  SlabStats stats_;
   FreeObjectList remote_list_;
   SlabCache* remote_cache_;
 
@@ -128,22 +171,37 @@ class SlabAllocator : public CacheAligned {
 
 class SlabAllocatorNode : public CacheAligned {
  public:
+  static const constexpr size_t kDepotMagazines = 16;
+
   SlabAllocatorNode(SlabAllocatorRoot& root, Nid nid);
 
+  SlabStats GetStats();
+
  private:
   void* Alloc();
   void* operator new(size_t size, Nid nid);
   void operator delete(void* p);
 
+  bool GetMagazine(FreeObjectList& magazine);
+  bool PutMagazine(FreeObjectList& magazine);
+  void FlushDepot(SlabCache& cache);
+  void Shrink(SlabCache& cache);
+
   SlabCache cache_;
   Nid nid_;
   SpinLock lock_;
+  // full magazines shared by the cores of this node
+  SpinLock depot_lock_;
+  boost::container::static_vector<FreeObjectList, kDepotMagazines> depot_;
 
   friend class SlabAllocator;
   friend class SlabAllocatorRoot;
 };
 
-class SlabAllocatorRoot {
+// Registered as a shrinker so that under memory pressure the free objects
+// cached by each core and node are returned to their slabs, handing
+// completely free slabs back to the page allocator
+class SlabAllocatorRoot : public PageAllocator::Shrinker {
  public:
   explicit SlabAllocatorRoot(size_t size, size_t align = 0);
   ~SlabAllocatorRoot();
@@ -153,8 +211,13 @@ class SlabAllocatorRoot {
   size_t NumObjectsPerSlab();
   SlabAllocator& GetCpuAllocator(size_t cpu_index = Cpu::GetMine());
   SlabAllocatorNode& GetNodeAllocator(Nid nid);
+  // Statistics of a core's allocator, zero if it has not allocated yet
+  SlabStats GetStats(size_t cpu_index) const;
+  // Statistics of a node's shared cache and depot
+  SlabStats GetNodeStats(Nid nid) const;
   void SetCpuAllocator(std::unique_ptr<SlabAllocator>, size_t cpu_index);
   void SetNodeAllocator(SlabAllocatorNode*, Nid nid);
+  void Shrink(Nid nid) override;
   size_t size() const { return size_; }
   size_t order() const { return order_; }
   size_t free_batch() const { return free_batch_; }
@@ -2,37 +2,30 @@
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
-#include "../Timer.h"
+#include "Timer.h"
 
 #include "Clock.h"
+#include "Cpuid.h"
 #include "EventManager.h"
 #include "Msr.h"
+#include "Rdtsc.h"
 
 const constexpr ebbrt::EbbId ebbrt::Timer::static_id;
+const constexpr std::chrono::microseconds
+    ebbrt::Timer::kDefaultTickGranularity;
 
 ebbrt::Timer::Timer() {
+  base_ = clock::Wall::Now().time_since_epoch();
+  for (auto& level : wheel_) {
+    level.min_expires.fill(UINT64_MAX);
+  }
+
   auto interrupt = event_manager->AllocateVector([this]() {
     auto now = clock::Wall::Now().time_since_epoch();
-    while (!timers_.empty() && timers_.begin()->fire_time_ <= now) {
-      auto& hook = *timers_.begin();
-
-      // remove from the set
-      timers_.erase(hook);
-
-      // If it needs repeating, put it back in with the updated time
-      if (hook.repeat_us_ != std::chrono::microseconds::zero()) {
-        hook.fire_time_ = now + hook.repeat_us_;
-        timers_.insert(hook);
-      }
-
-      hook.Fire();
-
-      now = clock::Wall::Now().time_since_epoch();
-    }
-    if (!timers_.empty()) {
-      SetTimer(std::chrono::duration_cast<std::chrono::microseconds>(
-          timers_.begin()->fire_time_ - now));
-    }
+    ++interrupts_;
+    programmed_tick_ = UINT64_MAX;
+    Advance(now);
+    Reprogram(clock::Wall::Now().time_since_epoch());
   });
 
   // Map timer to interrupt and enable one-shot mode
@@ -41,6 +34,7 @@ ebbrt::Timer::Timer() {
 
   // calibrate timer
   auto t = clock::Wall::Now().time_since_epoch();
+  auto tsc_start = rdtsc();
   // set timer
   msr::Write(msr::kX2apicInitCount, 0xFFFFFFFF);
 
@@ -49,12 +43,44 @@ ebbrt::Timer::Timer() {
   }
 
   auto remaining = msr::Read(msr::kX2apicCurrentCount);
+  auto tsc_end = rdtsc();
 
   // disable timer
   msr::Write(msr::kX2apicInitCount, 0);
   uint32_t elapsed = 0xFFFFFFFF;
   elapsed -= remaining;
   ticks_per_us_ = elapsed * 16 / 10000;
+
+  auto ns = (clock::TscToNano(tsc_end) - clock::TscToNano(tsc_start)).count();
+  tsc_per_ns_ = ((unsigned __int128)(tsc_end - tsc_start) << 32) / ns;
+
+  if (cpuid::features.tsc_deadline) {
+    // Switch to TSC-deadline mode (timer mode bits 18:17 = 10b). The LVT write
+    // is not ordered with later writes to the deadline MSR, hence the fence.
+    tsc_deadline_ = true;
+    msr::Write(msr::kX2apicLvtTimer, interrupt | (2 << 17));
+    asm volatile("mfence" : : : "memory");
+  }
+}
+
+// Arm the hardware timer to fire at an absolute time
+void ebbrt::Timer::SetDeadline(std::chrono::nanoseconds fire_time,
+                               std::chrono::nanoseconds now) {
+  auto from_now =
+      fire_time > now ? fire_time - now : std::chrono::nanoseconds::zero();
+  if (tsc_deadline_) {
+    // Wall clock time and the TSC have unrelated origins, so only the time
+    // remaining is converted to cycles
+    uint64_t deadline =
+        rdtsc() +
+        (((unsigned __int128)from_now.count() * tsc_per_ns_) >> 32);
+    // writing zero disarms the timer, so fire immediately with a deadline in
+    // the past instead
+    msr::Write(msr::kIa32TscDeadline, deadline == 0 ? 1 : deadline);
+    return;
+  }
+  // round up so we do not wake before the deadline has passed
+  SetTimer(std::chrono::microseconds((from_now.count() + 999) / 1000));
 }
 
 void ebbrt::Timer::SetTimer(std::chrono::microseconds from_now) {
@@ -86,31 +112,260 @@ void ebbrt::Timer::SetTimer(std::chrono::microseconds from_now) {
   msr::Write(msr::kX2apicInitCount, ticks);
 }
 
-void ebbrt::Timer::StopTimer() { msr::Write(msr::kX2apicInitCount, 0); }
+void ebbrt::Timer::StopTimer() {
+  if (tsc_deadline_) {
+    msr::Write(msr::kIa32TscDeadline, 0);
+  } else {
+    msr::Write(msr::kX2apicInitCount, 0);
+  }
+}
+
+void ebbrt::Timer::SetTickGranularity(std::chrono::microseconds tick) {
+  kbugon(armed_ != 0, "Cannot change tick granularity with armed timers\n");
+  kassert(tick.count() > 0);
+  base_ = clock::Wall::Now().time_since_epoch();
+  tick_ = tick;
+  current_tick_ = 0;
+}
+
+uint64_t ebbrt::Timer::TimeToTick(std::chrono::nanoseconds time) const {
+  if (time <= base_)
+    return 0;
+  return (time - base_).count() / tick_.count();
+}
+
+// The tick a hook should fire on. This is the first tick at or after its fire
+// time, so a hook never fires early, rounded up to the coarsest power of two
+// boundary its slack allows. Hooks with overlapping windows then tend to share
+// a tick.
+uint64_t ebbrt::Timer::ExpiryTick(const Hook& hook) const {
+  if (hook.fire_time_ <= base_)
+    return 0;
+  auto tick = tick_.count();
+  uint64_t expires = ((hook.fire_time_ - base_).count() + tick - 1) / tick;
+  uint64_t slack = std::chrono::nanoseconds(hook.slack_us_).count() / tick;
+  if (slack == 0)
+    return expires;
+  auto align = uint64_t(1) << (63 - __builtin_clzll(slack));
+  return (expires + align - 1) & ~(align - 1);
+}
+
+void ebbrt::Timer::Insert(Hook& hook) {
+  auto expires = hook.expires_;
+  if (expires < current_tick_)
+    expires = current_tick_;
+  auto delta = expires - current_tick_;
+  size_t level = 0;
+  while (level < kWheelLevels - 1 &&
+         delta >= (uint64_t(1) << (kWheelBits * (level + 1)))) {
+    ++level;
+  }
+  if (unlikely(delta >= (uint64_t(1) << (kWheelBits * kWheelLevels)))) {
+    // Beyond the range of the wheel, park it in the furthest slot. It is
+    // reinserted with its real expiry when that slot cascades.
+    expires = current_tick_ + (uint64_t(1) << (kWheelBits * kWheelLevels)) - 1;
+  }
+  auto slot = (expires >> (kWheelBits * level)) & (kWheelSlots - 1);
+  auto& wl = wheel_[level];
+  wl.slots[slot].push_back(hook);
+  wl.occupied |= uint64_t(1) << slot;
+  if (expires < wl.min_expires[slot])
+    wl.min_expires[slot] = expires;
+  hook.level_ = level;
+  hook.slot_ = slot;
+}
+
+void ebbrt::Timer::Remove(Hook& hook) {
+  if (hook.level_ == kExpiringLevel) {
+    expiring_.erase(expiring_.iterator_to(hook));
+    return;
+  }
+  auto& wl = wheel_[hook.level_];
+  auto& list = wl.slots[hook.slot_];
+  list.erase(list.iterator_to(hook));
+  if (list.empty()) {
+    wl.occupied &= ~(uint64_t(1) << hook.slot_);
+    wl.min_expires[hook.slot_] = UINT64_MAX;
+  }
+}
+
+namespace {
+// Distance (1 - 64) from slot idx to the next occupied slot in the bitmap,
+// wrapping around
+size_t NextOccupied(uint64_t occupied, size_t idx) {
+  auto shift = (idx + 1) & 63;
+  auto rotated =
+      shift == 0 ? occupied : (occupied >> shift) | (occupied << (64 - shift));
+  return __builtin_ctzll(rotated) + 1;
+}
+}  // namespace
+
+// The next tick at which the wheel has work to do, either expiring a level 0
+// slot or cascading a higher level slot
+bool ebbrt::Timer::NextSlotTick(uint64_t& tick) const {
+  auto found = false;
+  for (size_t level = 0; level < kWheelLevels; ++level) {
+    auto& wl = wheel_[level];
+    if (wl.occupied == 0)
+      continue;
+    auto shift = kWheelBits * level;
+    auto cur = current_tick_ >> shift;
+    auto t = (cur + NextOccupied(wl.occupied, cur & (kWheelSlots - 1)))
+             << shift;
+    if (!found || t < tick) {
+      tick = t;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// A lower bound on the earliest expiry in the wheel, used to program the
+// hardware timer so cascades do not cause interrupts of their own
+bool ebbrt::Timer::NextExpiryTick(uint64_t& tick) const {
+  auto found = false;
+  for (size_t level = 0; level < kWheelLevels; ++level) {
+    auto& wl = wheel_[level];
+    if (wl.occupied == 0)
+      continue;
+    auto shift = kWheelBits * level;
+    auto cur = current_tick_ >> shift;
+    auto occupied = wl.occupied;
+    while (occupied) {
+      auto next = cur + NextOccupied(occupied, cur & (kWheelSlots - 1));
+      auto idx = next & (kWheelSlots - 1);
+      auto slot_tick = next << shift;
+      // slots are visited in time order, nothing later can be earlier
+      if (found && slot_tick >= tick)
+        break;
+      auto expires = wl.min_expires[idx];
+      if (!found || expires < tick) {
+        tick = expires;
+        found = true;
+      }
+      occupied &= ~(uint64_t(1) << idx);
+    }
+  }
+  return found;
+}
+
+// Process every slot up to the current time, firing expired hooks
+void ebbrt::Timer::Advance(std::chrono::nanoseconds now) {
+  auto target = TimeToTick(now);
+  uint64_t next;
+  expiring_in_progress_ = true;
+  while (NextSlotTick(next) && next <= target) {
+    current_tick_ = next;
+    for (auto level = kWheelLevels - 1; level > 0; --level) {
+      auto mask = (uint64_t(1) << (kWheelBits * level)) - 1;
+      if ((next & mask) == 0)
+        Cascade(level, (next >> (kWheelBits * level)) & (kWheelSlots - 1));
+    }
+    ExpireSlot(next & (kWheelSlots - 1), now);
+  }
+  if (target > current_tick_)
+    current_tick_ = target;
+  expiring_in_progress_ = false;
+}
+
+void ebbrt::Timer::Cascade(size_t level, size_t slot) {
+  auto& wl = wheel_[level];
+  if (!(wl.occupied & (uint64_t(1) << slot)))
+    return;
+  HookList list;
+  list.swap(wl.slots[slot]);
+  wl.occupied &= ~(uint64_t(1) << slot);
+  wl.min_expires[slot] = UINT64_MAX;
+  while (!list.empty()) {
+    auto& hook = list.front();
+    list.pop_front();
+    Insert(hook);
+  }
+}
+
+void ebbrt::Timer::ExpireSlot(size_t slot, std::chrono::nanoseconds now) {
+  auto& wl = wheel_[0];
+  if (!(wl.occupied & (uint64_t(1) << slot)))
+    return;
+  for (auto& hook : wl.slots[slot]) {
+    hook.level_ = kExpiringLevel;
+  }
+  expiring_.splice(expiring_.end(), wl.slots[slot]);
+  wl.occupied &= ~(uint64_t(1) << slot);
+  wl.min_expires[slot] = UINT64_MAX;
+
+  // Fire the whole batch, a hook may stop others still in the batch
+  while (!expiring_.empty()) {
+    auto& hook = expiring_.front();
+    expiring_.pop_front();
+
+    // If it needs repeating, put it back in with the updated time
+    if (hook.repeat_us_ != std::chrono::microseconds::zero()) {
+      hook.fire_time_ = now + hook.repeat_us_;
+      hook.expires_ = std::max(ExpiryTick(hook), current_tick_ + 1);
+      Insert(hook);
+    } else {
+      --armed_;
+    }
+
+    hook.Fire();
+  }
+}
+
+void ebbrt::Timer::Reprogram(std::chrono::nanoseconds now) {
+  uint64_t tick;
+  if (!NextExpiryTick(tick)) {
+    programmed_tick_ = UINT64_MAX;
+    StopTimer();
+    return;
+  }
+  programmed_tick_ = tick;
+  SetDeadline(base_ + std::chrono::nanoseconds(tick * tick_.count()), now);
+}
 
 void ebbrt::Timer::Start(Hook& hook, std::chrono::microseconds timeout,
-                         bool repeat) {
+                         bool repeat, std::chrono::microseconds slack) {
   auto now = clock::Wall::Now().time_since_epoch();
+  if (hook.is_linked()) {
+    // restarting an armed hook
+    Remove(hook);
+    --armed_;
+  }
+  if (armed_ == 0) {
+    // nothing to cascade, skip ahead to the present
+    current_tick_ = std::max(current_tick_, TimeToTick(now));
+  }
   hook.fire_time_ = now + timeout;
-  if (timers_.empty() || *timers_.begin() > hook) {
-    SetTimer(timeout);
+  hook.repeat_us_ = repeat ? timeout : std::chrono::microseconds::zero();
+  hook.slack_us_ = slack;
+  auto expires = std::max(ExpiryTick(hook), current_tick_ + 1);
+  if (slack != std::chrono::microseconds::zero() &&
+      programmed_tick_ != UINT64_MAX && programmed_tick_ <= expires) {
+    // piggyback on the interrupt already programmed if it falls within our
+    // window
+    auto earliest = TimeToTick(hook.fire_time_ - std::chrono::nanoseconds(1)) + 1;
+    if (programmed_tick_ >= earliest && programmed_tick_ > current_tick_)
+      expires = programmed_tick_;
   }
+  hook.expires_ = expires;
+  Insert(hook);
+  ++armed_;
 
-  hook.repeat_us_ = repeat ? timeout : std::chrono::microseconds::zero();
-  timers_.insert(hook);
+  if (!expiring_in_progress_ && expires < programmed_tick_) {
+    Reprogram(now);
+  }
 }
 
 void ebbrt::Timer::Stop(Hook& hook) {
-  timers_.erase(hook);
+  if (!hook.is_linked())
+    return;
+  Remove(hook);
+  --armed_;
 
-  if (timers_.empty()) {
+  // Leave the hardware timer armed if other hooks are pending, a spurious
+  // interrupt is cheaper than recomputing the next expiry here
+  if (armed_ == 0 && !expiring_in_progress_) {
+    programmed_tick_ = UINT64_MAX;
     StopTimer();
-  } else {
-    auto now = clock::Wall::Now().time_since_epoch();
-    auto fire_time = timers_.begin()->fire_time_;
-    if (now < fire_time) {
-      SetTimer(std::chrono::duration_cast<std::chrono::microseconds>(fire_time -
-                                                                     now));
-    }
   }
 }
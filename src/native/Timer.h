@@ -0,0 +1,113 @@
+//          Copyright Boston University SESA Group 2013 - 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BAREMETAL_SRC_INCLUDE_EBBRT_TIMER_H_
+#define BAREMETAL_SRC_INCLUDE_EBBRT_TIMER_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include <boost/intrusive/list.hpp>
+
+#include "../MulticoreEbbStatic.h"
+
+namespace ebbrt {
+
+class Timer : public MulticoreEbbStatic<Timer> {
+ public:
+  static void ClassInit() {} // no class wide static initialization logic
+  
+  class Hook : public boost::intrusive::list_base_hook<> {
+   public:
+    virtual ~Hook() {}
+    virtual void Fire() = 0;
+
+   private:
+    std::chrono::nanoseconds fire_time_;
+    std::chrono::microseconds repeat_us_;
+    std::chrono::microseconds slack_us_;
+    // tick the hook fires on, somewhere within [fire_time_, +slack_us_]
+    uint64_t expires_;
+    // position in the timer wheel while armed
+    uint8_t level_;
+    uint8_t slot_;
+
+    friend Timer;
+  };
+
+  static const constexpr EbbId static_id = kTimerId;
+  static const constexpr std::chrono::microseconds kDefaultTickGranularity =
+      std::chrono::microseconds(1);
+
+  Timer();
+
+  // The hook may fire up to slack after the timeout, which lets the timer
+  // coalesce it with other nearby deadlines into a single interrupt
+  void Start(Hook&, std::chrono::microseconds timeout, bool repeat,
+             std::chrono::microseconds slack = std::chrono::microseconds::zero());
+  void Stop(Hook&);
+  // Number of timer interrupts taken on this core
+  uint64_t GetInterruptCount() const { return interrupts_; }
+  // Set the resolution of this core's timer wheel, timers are rounded up to a
+  // multiple of this. Must be called while no timers are armed.
+  void SetTickGranularity(std::chrono::microseconds tick);
+
+ private:
+  // Timers are kept in a hierarchical timing wheel. Each level has
+  // 64 slots, a slot at level l spans 64^l ticks. Hooks are placed according
+  // to how far in the future they expire and are cascaded down a level as
+  // time approaches their expiry, making Start and Stop O(1).
+  static const constexpr size_t kWheelBits = 6;
+  static const constexpr size_t kWheelSlots = 1 << kWheelBits;
+  static const constexpr size_t kWheelLevels = 6;
+  static const constexpr uint8_t kExpiringLevel = kWheelLevels;
+
+  typedef boost::intrusive::list<Hook> HookList;
+
+  struct WheelLevel {
+    // bitmap of non-empty slots
+    uint64_t occupied = 0;
+    std::array<HookList, kWheelSlots> slots;
+    // lower bound on the expiry tick of the hooks in each slot
+    std::array<uint64_t, kWheelSlots> min_expires;
+  };
+
+  uint64_t ExpiryTick(const Hook& hook) const;
+  uint64_t TimeToTick(std::chrono::nanoseconds time) const;
+  void Insert(Hook& hook);
+  void Remove(Hook& hook);
+  bool NextSlotTick(uint64_t& tick) const;
+  bool NextExpiryTick(uint64_t& tick) const;
+  void Advance(std::chrono::nanoseconds now);
+  void Cascade(size_t level, size_t slot);
+  void ExpireSlot(size_t slot, std::chrono::nanoseconds now);
+  void Reprogram(std::chrono::nanoseconds now);
+  void SetDeadline(std::chrono::nanoseconds fire_time,
+                   std::chrono::nanoseconds now);
+  void SetTimer(std::chrono::microseconds from_now);
+  void StopTimer();
+
+  uint64_t ticks_per_us_;
+  // use the TSC-deadline mode of the APIC timer rather than one-shot countdown
+  bool tsc_deadline_ = false;
+  // TSC ticks per nanosecond, in 32.32 fixed point
+  uint64_t tsc_per_ns_;
+  std::array<WheelLevel, kWheelLevels> wheel_;
+  // hooks removed from the wheel and waiting to be fired
+  HookList expiring_;
+  size_t armed_ = 0;
+  uint64_t current_tick_ = 0;
+  // tick the hardware timer is programmed for, or UINT64_MAX if it is off
+  uint64_t programmed_tick_ = UINT64_MAX;
+  bool expiring_in_progress_ = false;
+  uint64_t interrupts_ = 0;
+  std::chrono::nanoseconds base_;
+  std::chrono::nanoseconds tick_ = kDefaultTickGranularity;
+};
+
+const constexpr auto timer = EbbRef<Timer>(Timer::static_id);
+}  // namespace ebbrt
+
+#endif  // BAREMETAL_SRC_INCLUDE_EBBRT_TIMER_H_
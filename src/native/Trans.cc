@@ -46,14 +46,14 @@ void ebbrt::trans::ApInit(size_t index) {
       pte_root, kVMemStart, kVMemStart + pmem::kPageSize, 0, 4,
       [&](vmem::Pte& entry, uint64_t base_virt, size_t level) {
         kassert(!entry.Present());
-        auto page = p_allocator.Alloc(0, nid);
+        auto page = p_allocator.AllocLocal(0, UINT64_MAX);
         std::memset(reinterpret_cast<void*>(page.ToAddr()), 0, pmem::kPageSize);
         entry.Set(page.ToAddr() + (base_virt - kVMemStart), level > 0);
         std::atomic_thread_fence(std::memory_order_release);
         asm volatile("invlpg (%[addr])" : : [addr] "r"(base_virt) : "memory");
       },
       [&](vmem::Pte& entry) {
-        auto page = p_allocator.Alloc(0, nid);
+        auto page = p_allocator.AllocLocal(0, UINT64_MAX);
         auto page_addr = page.ToAddr();
         new (reinterpret_cast<void*>(page_addr)) vmem::Pte[512];
         entry.SetNormal(page_addr);
@@ -63,8 +63,7 @@ void ebbrt::trans::ApInit(size_t index) {
 
 void ebbrt::trans::HandleFault(idt::ExceptionFrame* ef, uintptr_t fault_addr) {
   auto vpage = ebbrt::Pfn::Down(fault_addr);
-  auto backing_page = ebbrt::page_allocator->Alloc();
-  memset(reinterpret_cast<void*>(backing_page.ToAddr()), 0, pmem::kPageSize);
+  auto backing_page = ebbrt::page_allocator->AllocZeroed();
   kbugon(backing_page == ebbrt::Pfn::None(),
          "Failed to allocate page for translation system\n");
   ebbrt::vmem::MapMemory(vpage, backing_page);
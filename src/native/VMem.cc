@@ -11,6 +11,7 @@
 
 #include "../Align.h"
 #include "CpuAsm.h"
+#include "Cpuid.h"
 #include "Debug.h"
 #include "E820.h"
 #include "EarlyPageAllocator.h"
@@ -18,6 +19,24 @@
 
 namespace {
 ebbrt::ExplicitlyConstructed<ebbrt::vmem::Pte> page_table_root;
+
+// the direct map uses 1GB pages wherever a usable region covers them
+size_t DirectMapPageSizes() {
+  return ebbrt::cpuid::features.pdpe1gb ? ebbrt::vmem::kMaxPageSizes
+                                        : ebbrt::vmem::kNumPageSizes;
+}
+
+void MapMemoryPages(uintptr_t vaddr, ebbrt::Pfn pfn, uint64_t length,
+                    size_t num_page_sizes) {
+  auto pte_root = ebbrt::vmem::Pte(ebbrt::ReadCr3());
+  TraversePageTable(
+      pte_root, vaddr, vaddr + length, 0, 4,
+      [=](ebbrt::vmem::Pte& entry, uint64_t base_virt, size_t level) {
+        ebbrt::vmem::InstallLeaf(entry, pfn.ToAddr() + (base_virt - vaddr),
+                                 level > 0);
+      },
+      ebbrt::vmem::InstallTable, num_page_sizes);
+}
 }
 
 void ebbrt::vmem::Init() { page_table_root.construct(); }
@@ -45,7 +64,8 @@ void ebbrt::vmem::EarlyMapMemory(uint64_t addr, uint64_t length) {
 
         entry.SetNormal(page_addr);
         return true;
-      });
+      },
+      DirectMapPageSizes());
 }
 
 void ebbrt::vmem::EarlyUnmapMemory(uint64_t addr, uint64_t length) {
@@ -65,7 +85,34 @@ void ebbrt::vmem::EarlyUnmapMemory(uint64_t addr, uint64_t length) {
         kprintf("Asked to unmap memory that wasn't mapped!\n");
         kabort();
         return false;
-      });
+      },
+      DirectMapPageSizes());
+}
+
+bool ebbrt::vmem::InstallTable(Pte& entry) {
+  // a zeroed page is a table of non present entries
+  auto page = page_allocator->AllocZeroed();
+  kbugon(page == Pfn::None());
+  Pte table;
+  table.SetNormal(page.ToAddr());
+  Pte expected;
+  if (!entry.CompareExchange(expected, table)) {
+    // another core installed a table first, use theirs
+    kassert(expected.Present() && !expected.Large());
+    page_allocator->Free(page);
+  }
+  return true;
+}
+
+void ebbrt::vmem::InstallLeaf(Pte& entry, uint64_t phys_addr, bool large) {
+  Pte leaf;
+  leaf.Set(phys_addr, large);
+  Pte expected;
+  if (!entry.CompareExchange(expected, leaf)) {
+    // e.g. two cores faulting on the same page of a region
+    kassert(expected.Present() && expected.Large() == large &&
+            expected.Addr(large) == phys_addr);
+  }
 }
 
 void ebbrt::vmem::MapMemory(Pfn vfn, Pfn pfn, uint64_t length) {
@@ -73,39 +120,37 @@ void ebbrt::vmem::MapMemory(Pfn vfn, Pfn pfn, uint64_t length) {
   auto vaddr = vfn.ToAddr();
   TraversePageTable(pte_root, vaddr, vaddr + length, 0, 4,
                     [=](Pte& entry, uint64_t base_virt, size_t level) {
-                      kassert(!entry.Present());
-                      entry.Set(pfn.ToAddr() + (base_virt - vaddr), level > 0);
-                      std::atomic_thread_fence(std::memory_order_release);
+                      InstallLeaf(entry, pfn.ToAddr() + (base_virt - vaddr),
+                                  level > 0);
                     },
-                    [](Pte& entry) {
-                      auto page = page_allocator->Alloc();
-                      kbugon(page == Pfn::None());
-                      auto page_addr = page.ToAddr();
-                      new (reinterpret_cast<void*>(page_addr)) Pte[512];
-                      entry.SetNormal(page_addr);
-                      return true;
-                    });
+                    InstallTable);
 }
 
-// traverses per core page table and backs vaddr with physical pages
-// in pfn
-void ebbrt::vmem::MapMemoryLarge(uintptr_t vaddr, Pfn pfn, uint64_t length) {
+void ebbrt::vmem::UnmapMemory(Pfn vfn, uint64_t length) {
   auto pte_root = Pte(ReadCr3());
+  auto vaddr = vfn.ToAddr();
   TraversePageTable(
       pte_root, vaddr, vaddr + length, 0, 4,
-      [=](Pte& entry, uint64_t base_virt, size_t level) {
-        kassert(!entry.Present());
-        entry.Set(pfn.ToAddr() + (base_virt - vaddr), level > 0);
+      [](Pte& entry, uint64_t base_virt, size_t level) {
+        if (!entry.Present())
+          return;
+        kassert(level == 0 || entry.Large());
+        entry.Clear();
         std::atomic_thread_fence(std::memory_order_release);
+        asm volatile("invlpg (%[addr])" : : [addr] "r"(base_virt) : "memory");
       },
-      [](Pte& entry) {
-        auto page = page_allocator->Alloc();
-        kbugon(page == Pfn::None());
-        auto page_addr = page.ToAddr();
-        new (reinterpret_cast<void*>(page_addr)) Pte[512];
-        entry.SetNormal(page_addr);
-        return true;
-      });
+      [](Pte& entry) { return false; });
+}
+
+// traverses per core page table and backs vaddr with physical pages
+// in pfn
+void ebbrt::vmem::MapMemoryLarge(uintptr_t vaddr, Pfn pfn, uint64_t length) {
+  MapMemoryPages(vaddr, pfn, length, kNumPageSizes);
+}
+
+void ebbrt::vmem::MapMemoryHuge(uintptr_t vaddr, Pfn pfn, uint64_t length) {
+  kbugon(!cpuid::features.pdpe1gb, "1GB pages are not supported\n");
+  MapMemoryPages(vaddr, pfn, length, kMaxPageSizes);
 }
 
 void ebbrt::vmem::EnableRuntimePageTable() {
@@ -119,7 +164,7 @@ void ebbrt::vmem::ApInit(size_t index) {
   Pte ap_pte_root;
   auto nid = Cpu::GetByIndex(index)->nid();
   auto& p_allocator = (*PageAllocator::allocators)[nid.val()];
-  auto page = p_allocator.Alloc(0, nid);
+  auto page = p_allocator.AllocLocal(0, UINT64_MAX);
   kbugon(page == Pfn::None(),
          "Failed to allocate page for initial page tables\n");
   auto page_addr = page.ToAddr();
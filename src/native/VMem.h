@@ -29,6 +29,13 @@ class Pte {
   }
   bool Large() const { return raw_ & (1 << 7); }
   void Clear() { raw_ = 0; }
+  // Atomically replace the entry if it still equals expected, otherwise
+  // expected is updated to the current entry
+  bool CompareExchange(Pte& expected, Pte desired) {
+    return __atomic_compare_exchange_n(&raw_, &expected.raw_, desired.raw_,
+                                       false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE);
+  }
   void SetPresent(bool val) { SetBit(0, val); }
   void SetWritable(bool val) { SetBit(1, val); }
   void SetLarge(bool val) { SetBit(7, val); }
@@ -64,8 +71,10 @@ class Pte {
   uint64_t raw_;
 };
 
-// TODO(dschatz): support 1g pages
+// Page sizes TraversePageTable maps with by default: 4KB and 2MB. Passing
+// kMaxPageSizes allows 1GB pages too, which requires cpuid::features.pdpe1gb
 const constexpr size_t kNumPageSizes = 2;
+const constexpr size_t kMaxPageSizes = 3;
 
 inline size_t PtIndex(uintptr_t virt_addr, size_t level) {
   return (virt_addr >> (12 + level * 9)) & ((1 << 9) - 1);
@@ -79,7 +88,8 @@ inline uint64_t Canonical(uint64_t addr) {
 template <typename Found_Entry_Func, typename Empty_Entry_Func>
 void TraversePageTable(Pte& entry, uint64_t virt_start, uint64_t virt_end,
                        uint64_t base_virt, size_t level, Found_Entry_Func found,
-                       Empty_Entry_Func empty) {
+                       Empty_Entry_Func empty,
+                       size_t num_page_sizes = kNumPageSizes) {
   if (!entry.Present())
     if (!empty(entry))
       return;
@@ -92,12 +102,15 @@ void TraversePageTable(Pte& entry, uint64_t virt_start, uint64_t virt_end,
   auto idx_end = PtIndex(std::min(virt_end - 1, base_virt_end), level);
   base_virt += Canonical(idx_begin * step);
   for (size_t idx = idx_begin; idx <= idx_end; ++idx) {
-    if (level < kNumPageSizes && virt_start <= base_virt &&
-        virt_end >= base_virt + step) {
+    // an existing large page is never descended into, even if the range
+    // only covers part of it
+    if ((level < num_page_sizes && virt_start <= base_virt &&
+         virt_end >= base_virt + step) ||
+        (level > 0 && pt[idx].Present() && pt[idx].Large())) {
       found(pt[idx], base_virt, level);
     } else {
       TraversePageTable(pt[idx], virt_start, virt_end, base_virt, level, found,
-                        empty);
+                        empty, num_page_sizes);
     }
     base_virt = Canonical(base_virt + step);
   }
@@ -108,9 +121,21 @@ void EnableRuntimePageTable();
 void EarlyMapMemory(uint64_t addr, uint64_t length);
 void EarlyUnmapMemory(uint64_t addr, uint64_t length);
 void MapMemory(Pfn vfn, Pfn pfn, uint64_t length = pmem::kPageSize);
+// Unmap from the calling core's page table, other cores' TLBs are not flushed
+void UnmapMemory(Pfn vfn, uint64_t length = pmem::kPageSize);
+// Map 1GB pages, requires cpuid::features.pdpe1gb
+void MapMemoryHuge(uintptr_t vaddr, Pfn pfn,
+                   uint64_t length = pmem::kHugePageSize);
 void MapMemoryLarge(uintptr_t vaddr, Pfn pfn,
                     uint64_t length = pmem::kLargePageSize);
 void ApInit(size_t index);
+// The tables below the root are shared by all cores, so entries in them may
+// be installed by several cores at once. InstallTable fills an empty entry
+// with a zeroed table, freeing it if another core installed one first, and
+// can be passed to TraversePageTable as the empty entry function.
+bool InstallTable(Pte& entry);
+// Map a leaf entry that another core may be mapping to the same frame
+void InstallLeaf(Pte& entry, uint64_t phys_addr, bool large);
 
 Pte& GetPageTableRoot();
 
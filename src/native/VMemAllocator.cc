@@ -4,12 +4,14 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 #include "VMemAllocator.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <cxxabi.h>
 #include <mutex>
 
 #include "../Align.h"
 #include "Cpu.h"
+#include "EventManager.h"
 #include "LocalIdMap.h"
 
 #include "PMem.h"
@@ -41,6 +43,60 @@ ebbrt::VMemAllocator& ebbrt::VMemAllocator::HandleFault(EbbId id) {
   return ref;
 }
 
+ebbrt::VMemAllocator::PageFaultHandler*
+ebbrt::VMemAllocator::RegionIndex::Find(Pfn pfn) const {
+  auto it = std::upper_bound(
+      entries.begin(), entries.end(), pfn,
+      [](Pfn pfn, const Entry& entry) { return pfn < entry.begin; });
+  if (it == entries.begin())
+    return nullptr;
+  --it;
+  if (!(pfn < it->end))
+    return nullptr;
+  return it->handler;
+}
+
+ebbrt::VMemAllocator::UpdateLock::UpdateLock(VMemAllocator& allocator)
+    : allocator_(allocator) {
+  allocator_.lock_.lock();
+}
+
+ebbrt::VMemAllocator::UpdateLock::~UpdateLock() {
+  auto old = allocator_.index_.exchange(allocator_.BuildIndex(),
+                                        std::memory_order_acq_rel);
+  if (old != nullptr)
+    allocator_.retired_.push_back(old);
+  std::vector<RegionIndex*> retired;
+  if (allocator_.rcu_enabled_)
+    retired.swap(allocator_.retired_);
+  allocator_.lock_.unlock();
+
+  // a fault that found an old index is still running in its event
+  if (!retired.empty()) {
+    event_manager->DoRcu([retired = std::move(retired)]() {
+      for (auto index : retired) {
+        delete index;
+      }
+    });
+  }
+}
+
+ebbrt::VMemAllocator::RegionIndex* ebbrt::VMemAllocator::BuildIndex() const {
+  auto index = new RegionIndex;
+  for (auto it = regions_.rbegin(); it != regions_.rend(); ++it) {
+    if (it->second.IsFree())
+      continue;
+    index->entries.push_back(RegionIndex::Entry{
+        it->first, it->second.end(), it->second.page_fault_handler()});
+  }
+  return index;
+}
+
+void ebbrt::VMemAllocator::EnableRcu() {
+  std::lock_guard<SpinLock> lock(lock_);
+  rcu_enabled_ = true;
+}
+
 /* construct VMemAllocator */
 ebbrt::VMemAllocator::VMemAllocator() {
   regions_.emplace(std::piecewise_construct,
@@ -52,7 +108,7 @@ ebbrt::Pfn
 ebbrt::VMemAllocator::Alloc(size_t npages,
                             std::unique_ptr<PageFaultHandler> pf_handler) {
 
-  std::lock_guard<SpinLock> lock(lock_);
+  UpdateLock lock(*this);
 
   for (auto it = regions_.begin(); it != regions_.end(); ++it) {
     /* it->first: Pfn start_addr */
@@ -98,7 +154,7 @@ ebbrt::VMemAllocator::AllocRange(size_t npages, uintptr_t vmem_start,
     return Pfn::None();
   }
 
-  std::lock_guard<SpinLock> lock(lock_);
+  UpdateLock lock(*this);
   uintptr_t vmem_end = vmem_start + (pmem::kPageSize * npages) - 1;
 
   /* Check requested range is valid */
@@ -174,7 +230,7 @@ ebbrt::VMemAllocator::AllocRange(size_t npages, uintptr_t vmem_start,
 ebbrt::Pfn
 ebbrt::VMemAllocator::Alloc(size_t npages, size_t pages_align,
                             std::unique_ptr<PageFaultHandler> pf_handler) {
-  std::lock_guard<SpinLock> lock(lock_);
+  UpdateLock lock(*this);
   for (auto it = regions_.begin(); it != regions_.end(); ++it) {
     const auto& begin = it->first;
     auto end = it->second.end();
@@ -213,15 +269,38 @@ ebbrt::VMemAllocator::Alloc(size_t npages, size_t pages_align,
          npages);
 }
 
-void ebbrt::VMemAllocator::HandlePageFault(idt::ExceptionFrame* ef) {
+ebbrt::VMemAllocator::Stats ebbrt::VMemAllocator::GetStats() {
   std::lock_guard<SpinLock> lock(lock_);
+  Stats stats = {};
+  for (auto& region : regions_) {
+    auto npages = region.second.end() - region.first;
+    ++stats.regions;
+    if (region.second.IsFree()) {
+      stats.free_pages += npages;
+      stats.largest_free_pages = std::max<uint64_t>(stats.largest_free_pages, npages);
+    } else {
+      ++stats.allocated_regions;
+      stats.allocated_pages += npages;
+      auto handler = region.second.page_fault_handler();
+      if (handler != nullptr)
+        stats.faults += handler->faults();
+    }
+  }
+  return stats;
+}
+
+void ebbrt::VMemAllocator::HandlePageFault(idt::ExceptionFrame* ef) {
   auto fault_addr = ReadCr2();
 
   if (fault_addr >= trans::kVMemStart) {
     trans::HandleFault(ef, fault_addr);
   } else {
-    auto it = regions_.lower_bound(Pfn::Down(fault_addr));
-    if (it == regions_.end() || it->second.end() < Pfn::Up(fault_addr)) {
+    // The fault runs within an event, which keeps the index from being freed
+    // until it returns
+    auto index = index_.load(std::memory_order_acquire);
+    auto handler =
+        index != nullptr ? index->Find(Pfn::Down(fault_addr)) : nullptr;
+    if (handler == nullptr) {
       kprintf_force("Page fault for address %llx, no handler for it\n",
                     fault_addr);
       kprintf_force("SS: %#018" PRIx64 " RSP: %#018" PRIx64 "\n", ef->ss,
@@ -249,7 +328,8 @@ void ebbrt::VMemAllocator::HandlePageFault(idt::ExceptionFrame* ef) {
       // TODO(dschatz): FPU
       kabort();
     }
-    it->second.HandleFault(ef, fault_addr);
+    handler->faults_.fetch_add(1, std::memory_order_relaxed);
+    handler->HandleFault(ef, fault_addr);
   }
 }
 
@@ -5,9 +5,11 @@
 #ifndef BAREMETAL_SRC_INCLUDE_EBBRT_VMEMALLOCATOR_H_
 #define BAREMETAL_SRC_INCLUDE_EBBRT_VMEMALLOCATOR_H_
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "../CacheAligned.h"
 #include "../SpinLock.h"
@@ -22,10 +24,33 @@ namespace ebbrt {
 class VMemAllocator : CacheAligned {
 
  public:
+  // Faults are dispatched without holding the allocator's lock, so the
+  // handler of a region touched by several cores may run concurrently on
+  // each of them
   class PageFaultHandler {
    public:
     virtual void HandleFault(idt::ExceptionFrame*, uintptr_t) = 0;
     virtual ~PageFaultHandler() {}
+
+    // number of faults dispatched to this handler
+    uint64_t faults() const { return faults_.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<uint64_t> faults_{0};
+
+    friend class VMemAllocator;
+  };
+
+  struct Stats {
+    uint64_t regions;
+    uint64_t allocated_regions;
+    uint64_t allocated_pages;
+    // a small largest free region relative to the free pages indicates a
+    // fragmented address space
+    uint64_t free_pages;
+    uint64_t largest_free_pages;
+    // faults dispatched to the handlers of allocated regions
+    uint64_t faults;
   };
 
   static void Init();
@@ -37,17 +62,20 @@ class VMemAllocator : CacheAligned {
             std::unique_ptr<PageFaultHandler> pf_handler = nullptr);
   Pfn AllocRange(size_t npages, uintptr_t vmem_start,
                  std::unique_ptr<PageFaultHandler> pf_handler = nullptr);
+  Stats GetStats();
+  // Free replaced region indexes through RCU, the event managers of all cores
+  // must be running. Until then they are kept.
+  void EnableRcu();
 
  private:
   class Region {
    public:
     explicit Region(Pfn addr) : end_(addr), allocated_(false) {}
     bool IsFree() const { return !allocated_; }
-    void HandleFault(idt::ExceptionFrame* ef, uintptr_t addr) {
-      kbugon(IsFree(), "Fault on a free region!\n");
-      page_fault_handler_->HandleFault(ef, addr);
-    }
     Pfn end() const { return end_; }
+    PageFaultHandler* page_fault_handler() const {
+      return page_fault_handler_.get();
+    }
     void set_end(Pfn end) { end_ = end; }
     void set_page_fault_handler(std::shared_ptr<PageFaultHandler> p) {
       page_fault_handler_ = std::move(p);
@@ -60,14 +88,44 @@ class VMemAllocator : CacheAligned {
     bool allocated_;
   };
 
+  // An immutable copy of the allocated regions sorted by start address,
+  // searched by the fault path without taking the lock
+  struct RegionIndex {
+    struct Entry {
+      Pfn begin;
+      Pfn end;
+      PageFaultHandler* handler;
+    };
+
+    PageFaultHandler* Find(Pfn pfn) const;
+
+    std::vector<Entry> entries;
+  };
+
+  // Takes the lock for an update of regions_, releasing it publishes a new
+  // index
+  class UpdateLock {
+   public:
+    explicit UpdateLock(VMemAllocator& allocator);
+    ~UpdateLock();
+
+   private:
+    VMemAllocator& allocator_;
+  };
+
   VMemAllocator();
 
   void HandlePageFault(idt::ExceptionFrame* ef);
+  RegionIndex* BuildIndex() const;
 
   SpinLock lock_;
 
   /* regions_: vmem regions sorted in descending order */
   std::map<Pfn, Region, std::greater<Pfn>> regions_;
+  std::atomic<RegionIndex*> index_{nullptr};
+  // replaced indexes waiting to be freed
+  std::vector<RegionIndex*> retired_;
+  bool rcu_enabled_ = false;
 
   const uintptr_t kVMemRangeStart = 0xFFFF800000000000;
   const uintptr_t kVMemRangeEnd = trans::kVMemStart; /*0xFFFFFFFF00000000*/
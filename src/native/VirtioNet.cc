@@ -8,6 +8,7 @@
 #include "../UniqueIOBuf.h"
 #include "Debug.h"
 #include "EventManager.h"
+#include "PooledIOBuf.h"
 
 namespace {
 const constexpr uint32_t kCSum = 0;
@@ -122,7 +123,7 @@ ebbrt::VirtioNetDriver::VirtioNetDriver(pci::Device& dev)
     bufs.reserve(num_bufs);
 
     for (size_t i = 0; i < num_bufs; ++i) {
-      bufs.emplace_back(MakeUniqueIOBuf(65562));
+      bufs.emplace_back(MakePooledIOBuf(65562));
     }
 
     auto it = rcv_queue.AddWritableBuffers(bufs.begin(), bufs.end());
@@ -170,7 +171,7 @@ void ebbrt::VirtioNetDriver::Send(std::unique_ptr<IOBuf> buf,
 }
 
 void ebbrt::VirtioNetRep::Send(std::unique_ptr<IOBuf> buf, PacketInfo pinfo) {
-  std::unique_ptr<MutUniqueIOBuf> b;
+  std::unique_ptr<MutPooledIOBuf> b;
 
   snd_queue_.ClearUsedBuffers();
   VirtioNetHeader* header;
@@ -178,7 +179,7 @@ void ebbrt::VirtioNetRep::Send(std::unique_ptr<IOBuf> buf, PacketInfo pinfo) {
 #ifdef VIRTIO_ZERO_COPY
   if (free_desc > buf->CountChainElements()) {
     // we have enough descriptors to avoid a copy
-    b = MakeUniqueIOBuf(sizeof(VirtioNetHeader), /* zero_memory = */ true);
+    b = MakePooledIOBuf(sizeof(VirtioNetHeader), /* zero_memory = */ true);
     header = reinterpret_cast<VirtioNetHeader*>(b->MutData());
     b->PrependChain(std::move(buf));
   } else  // NOLINT
@@ -187,7 +188,7 @@ void ebbrt::VirtioNetRep::Send(std::unique_ptr<IOBuf> buf, PacketInfo pinfo) {
     // XXX: Maybe we should use indirect descriptors instead?
     // copy into one buffer
     auto len = buf->ComputeChainDataLength();
-    b = MakeUniqueIOBuf(len + sizeof(VirtioNetHeader));
+    b = MakePooledIOBuf(len + sizeof(VirtioNetHeader));
     memset(b->MutData(), 0, sizeof(VirtioNetHeader));
     header = reinterpret_cast<VirtioNetHeader*>(b->MutData());
     auto data = b->MutData() + sizeof(VirtioNetHeader);
@@ -279,7 +280,7 @@ void ebbrt::VirtioNetRep::FillRxRing() {
   bufs.reserve(num_bufs);
 
   for (size_t i = 0; i < num_bufs; ++i) {
-    bufs.emplace_back(MakeUniqueIOBuf(65562));
+    bufs.emplace_back(MakePooledIOBuf(65562));
   }
 
   auto it = rcv_queue_.AddWritableBuffers(bufs.begin(), bufs.end());